@@ -15,7 +15,11 @@
 #include "Fractals.h"
 #include "vecio.h"
 #include "matvec_read.h"
+#include "chaossimd.h"
+#include "ifsrender.h"
+#include "genomes.h"
 #define DOTSIZE 1 //must be an odd positive integer
+#define ORBITBATCH 256 //points generated at a time when streaming
 
 void func(double *x, double *y, double **genome, int funcnum){
     /* This function computes the transformation of a point (x, y) by a 
@@ -34,14 +38,14 @@ void func(double *x, double *y, double **genome, int funcnum){
     (*y) = genome[0][ind+2] * oldx + genome[0][ind+3] * oldy + genome[1][addind+1];
 }
 
-double validranddouble(void){
+double validranddouble(struct Rand *rng){
     /* This function generates random values
      * within a specific range for IFS parameters
      */
-    return (double)rand()/RAND_MAX * 2 - 1;
+    return randdouble(rng) * 2 - 1;
 }
 
-void generatemults(double **genome, int *multparams){
+int generatemults(double **genome, int *multparams, struct Rand *rng){
     /* This function generates the multiplicative parameters 
      * of each function in an IFS. ie., the parameters that are not
      * the +c or +e in the functions defined in the func() function
@@ -50,22 +54,26 @@ void generatemults(double **genome, int *multparams){
      * and the function is checked if it satisfies contractivity
      * conditions. If the function does not satisfy the contractivity
      * conditions, all parameters for that function are regenerated.
+     *
+     * Returns the number of tries it took to find a contractive function
      */
     double specrad = 0;
+    int tries = 0;
     int i = *multparams; 
     while (specrad == 0){
+        tries++;
         for (int j = i; j < i + 4; j++){
-            genome[0][j] = validranddouble();
+            genome[0][j] = validranddouble(rng);
         }
         specrad = validatefunc(genome[0][i], genome[0][i+1], genome[0][i+2], genome[0][i+3]);
     }
     int funcind = (int)(i/4);
     genome[3][funcind] = specrad;
     *multparams += 4;
-    return;
+    return tries;
 }
 
-void generateadds(double **genome, int *addparams){
+void generateadds(double **genome, int *addparams, struct Rand *rng){
     /* This function generates the additive parameters
      * for each function in the IFS. ie., the +c or +e in the 
      * functions defined in the func() function.
@@ -75,7 +83,7 @@ void generateadds(double **genome, int *addparams){
      * -1 and 1.
      */
     for (int i = *addparams; i < *addparams + 2; i++){
-        genome[1][i] = (double)rand()/RAND_MAX*2. - 1.;
+        genome[1][i] = randdouble(rng)*2. - 1.;
     }
     *addparams += 2;
     return;
@@ -96,8 +104,8 @@ void generategenome(struct Fractal *frac){
     double **genome = frac -> genome;
     double sumspecrad = 0;
     for (i = 0; i < frac -> numfuncs; i++){
-        generatemults(genome, &multparams);
-        generateadds(genome, &addparams);
+        frac -> multtries += generatemults(genome, &multparams, &frac -> rng);
+        generateadds(genome, &addparams, &frac -> rng);
 	sumspecrad += genome[3][i];
     }
 
@@ -111,37 +119,10 @@ void generategenome(struct Fractal *frac){
 }
 
 void ordergenome(int numfuncs, double **genome){
-    /* This function is used to order the functions in the 
-    * fractal genome. This is done by sorting rows of a
-    * matrix where each row represents a function
+    /* This function is used to order the functions in the
+    * fractal genome by spectral radius, in place (see sortgenome)
     */
-    int i,j;
-    double **genomefuncs = dmatmem(numfuncs, 8);
-    /* Setting values in the genomefuncs matrix */
-    for (i = 0; i < numfuncs; i++){
-    	genomefuncs[i][0] = genome[3][i];
-    	genomefuncs[i][1] = genome[0][4*i+0];
-    	genomefuncs[i][2] = genome[0][4*i+1];
-    	genomefuncs[i][3] = genome[0][4*i+2];
-    	genomefuncs[i][4] = genome[0][4*i+3];
-    	genomefuncs[i][5] = genome[1][2*i+0];
-    	genomefuncs[i][6] = genome[1][2*i+1];
-    	genomefuncs[i][7] = genome[2][i];
-    }
-    dsortmatrows(numfuncs, 0, genomefuncs);
-    /* Converting back to genome of the fractal */
-
-    for (i = 0; i < numfuncs; i++){
-        for (j = 0; j < 4; j++){
-	    genome[0][4*i+j] = genomefuncs[i][j+1];
-	}
-	for (j = 0; j < 2; j++){
-            genome[1][2*i+j] = genomefuncs[i][j+5];
-	}
-        genome[2][i] = genomefuncs[i][7];
-        genome[3][i] = genomefuncs[i][0];
-    }
-    dfreemat(numfuncs, genomefuncs);
+    sortgenome(numfuncs, genome[0], genome[1], genome[2], genome[3]);
     return;
 }
 
@@ -171,17 +152,10 @@ double validatefunc(double a, double b, double c, double d){
     // spectral radius less than 1. The above checks this,
     // but we will order the functions based on spectral
     // raidus anyway, so we might as well calculate it.
-    double Tr = a + d;
-    double det = a * d - b * c;
-    double discr = Tr * Tr - 4 * det;
-    if (discr < 0) return 0;
-    else {
-        double abslambda1 = fabs((Tr + sqrt(discr))*0.5);
-    	double abslambda2 = fabs((Tr - sqrt(discr))*0.5);
-	if (abslambda1 >= 1 || abslambda2 >= 1) return 0;
-	else if (abslambda1 >= abslambda2) return abslambda1;
-	else return abslambda2;
-    }
+    // (see contractive in genomes.c)
+    double specrad;
+    contractive(&a, &b, &c, &d, &specrad, 1);
+    return specrad;
 }
 
 double ** mallocgenome(int numfuncs){
@@ -207,18 +181,57 @@ double ** mallocgenome(int numfuncs){
     return genome;
 }
 
-void initializefrac(struct Fractal *frac, int numfuncs, int numpoints){
-    /* This function initializes a fractal structure. The number of
-     * points and number of functions has to be defined before it 
-     * can be called. This function then allocates memory for the
-     * x and y points that will be generated as well as allocating 
-     * memory for the matrix representing the picture of the fractal.
+static void growpoints(struct Fractal *frac, int numpoints){
+    /* This function makes room for numpoints stored points */
+    if (numpoints <= frac -> cappoints) return;
+    if ((frac -> xs = (double *)realloc(frac -> xs, numpoints * sizeof(double))) == NULL ||
+        (frac -> ys = (double *)realloc(frac -> ys, numpoints * sizeof(double))) == NULL ||
+        (frac -> colours = (int *)realloc(frac -> colours, numpoints * sizeof(int))) == NULL){
+        fprintf(stderr, "Malloc Failed. (initialize points)\n");
+        exit(1);
+    }
+    frac -> cappoints = numpoints;
+}
+
+void initfrac(struct Fractal *frac, struct FracConfig *cfg){
+    /* This function initializes a fractal structure for the given
+     * config. It allocates memory for the genome and the matrix
+     * representing the picture of the fractal, and unless the
+     * fractal is streamed (cfg -> stream), for the x and y points
+     * that will be generated. Fractals drawn by ENGINE_IFS have no
+     * points and are always streamed. See resetfrac()
+     */
+    frac -> capfuncs  = 0;
+    frac -> cappoints = 0;
+    frac -> genome    = NULL;
+    frac -> params    = NULL;
+    frac -> fparams   = NULL;
+    frac -> thresh    = NULL;
+    frac -> xs        = NULL;
+    frac -> ys        = NULL;
+    frac -> colours   = NULL;
+    frac -> bm.data   = NULL;
+    frac -> bm.capacity   = 0;
+    frac -> ssbm.data     = NULL;
+    frac -> ssbm.capacity = 0;
+    resetfrac(frac, cfg);
+}
+
+void resetfrac(struct Fractal *frac, struct FracConfig *cfg){
+    /* This function gets a fractal made by initfrac ready to be
+     * drawn again for the given config, so that one fractal can be
+     * used for many (see remakefrac). Memory is only allocated when
+     * the config needs more functions, points or pixels than the
+     * fractal has held before, so a fractal reused with the same
+     * config never allocates.
      *
      * All values corresponding to the fractal other than numfuncs,
      * numpoints, and whether the fractal is colours or not
      * are initialized to -1
      */
     int i;
+    int numfuncs  = cfg -> numfuncs;
+    int numpoints = cfg -> numpoints;
     frac -> fracnum   = -1;
     frac -> numfuncs  = numfuncs;
     frac -> numpoints = numpoints;
@@ -227,43 +240,247 @@ void initializefrac(struct Fractal *frac, int numfuncs, int numpoints){
     frac -> avgy      = -1;
     frac -> stddevx   = -1;
     frac -> stddevy   = -1;
+    frac -> covxy     = 0;
+    frac -> orientation = 0;
     frac -> dimension = -1;
+    frac -> corrdim   = -1;
     frac -> dist      = -1;
+    frac -> seed      = 0;
+    frac -> multtries = 0;
+    frac -> stream    = (cfg -> stream != 0 || cfg -> engine == ENGINE_IFS);
+    frac -> pointsused  = numpoints;
+    frac -> adaptwindow = cfg -> adaptwindow;
+    frac -> adaptrate   = cfg -> adaptrate;
+    frac -> minpoints   = cfg -> minpoints;
+    frac -> engine    = cfg -> engine;
+    frac -> converged = 1;
+    frac -> precision = (cfg -> engine == ENGINE_SIMD) ? cfg -> precision : PREC_DOUBLE;
+    for (i = 0; i < 4; i++) frac -> window[i] = cfg -> window[i];
     frac -> coloured  = 1; //dont colour fractals by function by default
                            //to make them coloured by function by default
                            //change this to 0
 
+    seedrand(&frac -> rng, 0);
+
     /* initialize genome */
-    double **genome = mallocgenome(numfuncs);
-    frac -> genome = genome;
+    if (numfuncs > frac -> capfuncs){
+        if (frac -> genome != NULL) freegenome(frac);
+        frac -> genome = mallocgenome(numfuncs);
+        if ((frac -> params = (double *)realloc(frac -> params, 6*numfuncs*sizeof(double))) == NULL ||
+            (frac -> fparams = (float *)realloc(frac -> fparams, 6*numfuncs*sizeof(float))) == NULL ||
+            (frac -> thresh = (uint32_t *)realloc(frac -> thresh, numfuncs*sizeof(uint32_t))) == NULL){
+            fprintf(stderr, "Malloc failed (initializefrac)\n");
+            exit(1);
+        }
+        frac -> capfuncs = numfuncs;
+    }
 
     /* initialize xs, ys, colour vector, and specrad*/
-    if ((frac -> xs = (double *)malloc(numpoints * sizeof(double))) == NULL){
-        fprintf(stderr, "Malloc Failed. (initialize points)\n");
-        exit(1);
+    if (frac -> stream == 0) growpoints(frac, numpoints);
+
+    /* initizlize the pixel map */
+    frac -> supersample = (cfg -> supersample > 1) ? cfg -> supersample : 1;
+    if (frac -> supersample > 1){
+        /* an anti-aliased picture: the pixels count how many of their
+         * subpixels, kept as bits, are covered by the attractor */
+        bmreshape(&frac -> bm, cfg -> width, cfg -> height, PIX_U16, cfg -> layout);
+        bmreshape(&frac -> ssbm, cfg -> width * frac -> supersample, cfg -> height * frac -> supersample,
+                  PIX_BIT, LAYOUT_ROWS);
     }
-    if ((frac -> ys = (double *)malloc(numpoints * sizeof(double))) == NULL){
-        fprintf(stderr, "Malloc Failed. (initialize points)\n");
-        exit(1);
+    else bmreshape(&frac -> bm, cfg -> width, cfg -> height, cfg -> pixtype, cfg -> layout);
+    return;
+}
+
+void defaultconfig(struct FracConfig *cfg, int numfuncs, int numpoints){
+    /* This function fills in a config with the default settings:
+     * no cutoff, the [-8,8]x[-8,8] window, stored points, the scalar
+     * engine and a WIDTH x HEIGHT bit map
+     */
+    cfg -> numfuncs  = numfuncs;
+    cfg -> numpoints = numpoints;
+    cfg -> cutoff    = 0;
+    cfg -> window[0] = -8;
+    cfg -> window[1] =  8;
+    cfg -> window[2] = -8;
+    cfg -> window[3] =  8;
+    cfg -> stream    = 0;
+    cfg -> autofit   = 0;
+    cfg -> engine    = ENGINE_SCALAR;
+    cfg -> width     = WIDTH;
+    cfg -> height    = HEIGHT;
+    cfg -> pixtype   = PIX_BIT;
+    cfg -> layout    = LAYOUT_ROWS;
+    cfg -> supersample = 1;
+    cfg -> adaptwindow = 0;
+    cfg -> adaptrate   = 0;
+    cfg -> minpoints   = 0;
+    cfg -> precision   = PREC_DOUBLE;
+}
+
+void initializefrac(struct Fractal *frac, int numfuncs, int numpoints){
+    /* This function initializes a fractal structure that keeps
+     * its points, with the default config. See initfrac()
+     */
+    struct FracConfig cfg;
+    defaultconfig(&cfg, numfuncs, numpoints);
+    initfrac(frac, &cfg);
+}
+
+void packgenome(struct Fractal *frac){
+    /* This function copies the parameters of the genome into
+     * frac -> params as one array per parameter, so that they
+     * can be looked up (or gathered by the simd engine) by 
+     * function number. It also builds the selection thresholds:
+     * thresh[j] is the cumulative probability of functions 0..j
+     * scaled to 32 bits (see selectfuncs). Walkers that are not
+     * run in double get their own copy of params (see chaossimd.c)
+     */
+    int n = frac -> numfuncs;
+    double p = 0;
+    for (int i = 0; i < n; i++){
+        for (int j = 0; j < 4; j++){
+            frac -> params[j*n + i] = frac -> genome[0][4*i+j];
+        }
+        frac -> params[4*n + i] = frac -> genome[1][2*i+0];
+        frac -> params[5*n + i] = frac -> genome[1][2*i+1];
+        p += frac -> genome[2][i];
+        double t = p * 4294967296.0;
+        frac -> thresh[i] = (t >= 4294967295.0) ? UINT32_MAX : (uint32_t)t;
     }
-    if ((frac -> colours = (int *)malloc(numpoints * sizeof(int))) == NULL){
-        fprintf(stderr, "Malloc Failed. (initialize points)\n");
-        exit(1);
+    if (frac -> precision == PREC_FLOAT){
+        for (int i = 0; i < 6*n; i++) frac -> fparams[i] = (float)frac -> params[i];
     }
-    /* initizlize the pixel map */
-    int **bm;
-    if ((bm = (int **)malloc(HEIGHT*sizeof(int *))) == NULL){
-        fprintf(stdout, "Malloc Failed. (makematrix)\n");
-        exit(1);
+}
+
+void startorbit(struct Fractal *frac){
+    /* This function starts the orbit of the chaos game at a 
+     * random point. The first 100 points are thrown away to 
+     * ensure that all (or close to all) points that follow 
+     * correspond to the fractal.
+     *
+     * With the simd engine, the walkers are started instead
+     */
+    packgenome(frac);
+    if (frac -> engine == ENGINE_SIMD){
+        startwalkers(frac);
+        return;
     }
-    for (i = 0; i < HEIGHT; i++){
-        if ((bm[i] = (int *)malloc(WIDTH*sizeof(int))) == NULL){
-            fprintf(stderr, "Malloc Failed. (makematrix)\n");
-            exit(1);
-        }
+    struct Rand *rng = &frac -> rng;
+    double x = randdouble(rng);
+    double y = randdouble(rng);
+    for (int i = 0; i < 100; i++){
+        func(&x, &y, frac -> genome, randint(rng, frac -> numfuncs));
+    }
+    frac -> orbitx = x;
+    frac -> orbity = y;
+}
+
+/* The functions below pick the function used for each of n points
+ * from the fractal's selection thresholds (see packgenome). A 32 bit
+ * random number r picks function j when thresh[j-1] <= r < thresh[j],
+ * which is found by counting the thresholds r is past rather than
+ * searching, so there are no branches that depend on r. Two picks are
+ * made from each 64 bit random number. The choices are written to
+ * funcs[0], funcs[stride], ... so walkers can share one array.
+ *
+ * Versions with the number of functions fixed at compile time are
+ * made for the common IFS sizes so their inner loops are unrolled.
+ */
+#define SELECTLOOP(numfuncs) \
+    int i, j; \
+    uint32_t r; \
+    uint64_t bits = 0; \
+    for (i = 0; i < n; i++){ \
+        if ((i & 1) == 0) bits = nextrand(rng); \
+        else bits >>= 32; \
+        r = (uint32_t)bits; \
+        int funcnum = 0; \
+        for (j = 0; j < (numfuncs) - 1; j++){ \
+            funcnum += (r >= thresh[j]); \
+        } \
+        funcs[i*stride] = funcnum; \
+    }
+
+#define DEFINESELECT(N) \
+static void select##N(const uint32_t *thresh, struct Rand *rng, int *funcs, int n, int stride){ \
+    SELECTLOOP(N) \
+}
+DEFINESELECT(2)
+DEFINESELECT(4)
+DEFINESELECT(6)
+DEFINESELECT(8)
+
+static void selectany(const uint32_t *thresh, int numfuncs, struct Rand *rng, int *funcs, int n, int stride){
+    SELECTLOOP(numfuncs)
+}
+
+void selectfuncs(struct Fractal *frac, struct Rand *rng, int *funcs, int n, int stride){
+    /* This function picks the functions for the next n points of an
+     * orbit using the random stream rng. See the comment above
+     */
+    const uint32_t *thresh = frac -> thresh;
+    switch (frac -> numfuncs){
+        case 2:  select2(thresh, rng, funcs, n, stride); break;
+        case 4:  select4(thresh, rng, funcs, n, stride); break;
+        case 6:  select6(thresh, rng, funcs, n, stride); break;
+        case 8:  select8(thresh, rng, funcs, n, stride); break;
+        default: selectany(thresh, frac -> numfuncs, rng, funcs, n, stride);
+    }
+}
+
+void orbitpoints(struct Fractal *frac, double *xs, double *ys, int *colours, int n){
+    /* This function continues the orbit of the chaos game for n 
+     * points. For each point it randomly picks a function in the 
+     * fractal, according to the probabilities in genome[2], and
+     * uses it to transform the last point.
+     */
+    int i, funcnum;
+    if (frac -> engine == ENGINE_SIMD){
+        walkerpoints(frac, xs, ys, colours, n);
+        return;
+    }
+    //note: colours get put to pixels in stamppoints (below)
+    //      and colours chosen are in PNGio.c
+    selectfuncs(frac, &frac -> rng, colours, n, 1);
+    int nf = frac -> numfuncs;
+    const double *a = frac -> params;
+    const double *b = a + nf;
+    const double *c = a + 2*nf;
+    const double *d = a + 3*nf;
+    const double *e = a + 4*nf;
+    const double *f = a + 5*nf;
+    double x = frac -> orbitx;
+    double y = frac -> orbity;
+    double oldx;
+    for (i = 0; i < n; i++){
+        funcnum = colours[i];
+        oldx = x;
+        x = a[funcnum] * oldx + b[funcnum] * y + e[funcnum];
+        y = c[funcnum] * oldx + d[funcnum] * y + f[funcnum];
+        xs[i] = x;
+        ys[i] = y;
+    }
+    frac -> orbitx = x;
+    frac -> orbity = y;
+}
+
+void updateextrema(double *extrema, double *xs, double *ys, int n, int first){
+    /* This function updates the extrema (minx, maxx, miny, maxy)
+     * of a set of points with n more points. If first is nonzero
+     * the extrema are started from the first of these points.
+     */
+    int i;
+    if (n <= 0) return;
+    if (first != 0){
+        extrema[0] = extrema[1] = xs[0];
+        extrema[2] = extrema[3] = ys[0];
+    }
+    for (i = 0; i < n; i++){
+        if (xs[i] < extrema[0]) extrema[0] = xs[i];
+        if (xs[i] > extrema[1]) extrema[1] = xs[i];
+        if (ys[i] < extrema[2]) extrema[2] = ys[i];
+        if (ys[i] > extrema[3]) extrema[3] = ys[i];
     }
-    frac -> bm = bm;
-    return;
 }
 
 void generatepoints(struct Fractal *frac, double *extrema){
@@ -272,56 +489,79 @@ void generatepoints(struct Fractal *frac, double *extrema){
      * in the fractal and uses it to transform a random 
      * point. A new function is then picked and transforms 
      * the output from the last point. This continues until
-     * numpoints points are generated. Additionally, the 
-     * first 100 points are thrown away to ensure that all 
-     * (or close to all) points correspond to the fractal. 
+     * numpoints points are generated. 
      */
-    int i,j;
-    int funcnum;
-    double p, num;
-    double x = (double)rand()/RAND_MAX; 
-    double y = (double)rand()/RAND_MAX;
-    double maxx = 0;
-    double minx = 0;
-    double maxy = 0;
-    double miny = 0;
-    for (i = 0; i < 100; i++){
-        funcnum = rand()%frac -> numfuncs;
-        func(&x, &y, frac -> genome, funcnum);
+    startorbit(frac);
+    orbitpoints(frac, frac -> xs, frac -> ys, frac -> colours, frac -> numpoints);
+    extrema[0] = extrema[1] = extrema[2] = extrema[3] = 0;
+    updateextrema(extrema, frac -> xs, frac -> ys, frac -> numpoints, 1);
+}
+
+int fixedpointsinside(struct Fractal *frac, double *window){
+    /* This function checks that the fixed point of every function
+     * in the IFS lies strictly inside the window. The fixed points
+     * are part of the attractor, so if one is outside the window
+     * the fractal can be rejected without running the chaos game.
+     * Returns 1 if all fixed points are inside, 0 otherwise.
+     *
+     * The fixed point of x -> Ax + t is (I - A)^-1 t, which exists
+     * as the spectral radius of A is less than 1.
+     */
+    double **genome = frac -> genome;
+    for (int i = 0; i < frac -> numfuncs; i++){
+        double a = 1 - genome[0][4*i+0];
+        double b =   - genome[0][4*i+1];
+        double c =   - genome[0][4*i+2];
+        double d = 1 - genome[0][4*i+3];
+        double e = genome[1][2*i+0];
+        double f = genome[1][2*i+1];
+        double det = a * d - b * c;
+        double x = ( d * e - b * f)/det;
+        double y = (-c * e + a * f)/det;
+        if (!(x > window[0] && x < window[1] && y > window[2] && y < window[3])) return 0;
     }
-    for (i = 0; i < frac -> numpoints; i++){
-        num = (double)rand()/RAND_MAX;
-        p = 0.0;
-        funcnum = 0;
-        for (j = 0; j < frac -> numfuncs; j++){
-            p += frac -> genome[2][j];
-            if (num < p) {
-                func(&x,&y,frac -> genome, funcnum);
-                frac -> xs[i] = x;
-                frac -> ys[i] = y;
-                
-                //note: colours get put to pixels in generatebm (below)
-                //      and colours chosen are in PNGio.c
-                frac -> colours[i] = funcnum;
-		if (i == 0){
-		    maxx = x;
-		    minx = x;
-		    maxy = y;
-		    miny = y;
-		}
-                if (x > maxx) maxx = x;
-                if (x < minx) minx = x;
-                if (y > maxy) maxy = y;
-                if (y < miny) miny = y;
-                break;
-            }
-            else funcnum ++;
-        }
+    return 1;
+}
+
+void pilotorbit(struct Fractal *frac, double *extrema, int n){
+    /* This function runs a short chaos game of n points, without
+     * drawing or storing them, to estimate the extrema of the attractor
+     */
+    double xs[ORBITBATCH], ys[ORBITBATCH];
+    int colours[ORBITBATCH];
+    int i, m;
+    startorbit(frac);
+    extrema[0] = extrema[1] = extrema[2] = extrema[3] = 0;
+    for (i = 0; i < n; i += m){
+        m = n - i;
+        if (m > ORBITBATCH) m = ORBITBATCH;
+        orbitpoints(frac, xs, ys, colours, m);
+        updateextrema(extrema, xs, ys, m, i == 0);
     }
-    extrema[0] = minx;
-    extrema[1] = maxx;
-    extrema[2] = miny;
-    extrema[3] = maxy;
+}
+
+int insidewindow(double *extrema, double *window){
+    /* This function returns 1 if the extrema lie strictly inside the window */
+    return (extrema[0] > window[0] && extrema[1] < window[1] &&
+            extrema[2] > window[2] && extrema[3] < window[3]);
+}
+
+void fitwindow(double *window, double *extrema, double margin){
+    /* This function picks a square viewing window around the
+     * given extrema, padded on each side by margin times its size,
+     * so that the attractor fills as much of the image as possible
+     * without being stretched.
+     */
+    double cx = (extrema[0] + extrema[1])/2;
+    double cy = (extrema[2] + extrema[3])/2;
+    double half = extrema[1] - extrema[0];
+    if (extrema[3] - extrema[2] > half) half = extrema[3] - extrema[2];
+    half = half/2 * (1 + 2 * margin);
+    if (half < 1e-9) half = 1e-9;
+    window[0] = cx - half;
+    window[1] = cx + half;
+    window[2] = cy - half;
+    window[3] = cy + half;
 }
 
 void generatefrac(struct Fractal *frac, double *extrema){
@@ -334,65 +574,209 @@ void generatefrac(struct Fractal *frac, double *extrema){
     generatepoints(frac, extrema);
 }
 
-void pointtocoord(int *coords, double x, double y, double minx, double maxx, double miny, double maxy){
+void pointtocoord(int *coords, double x, double y, double minx, double maxx, double miny, double maxy, int width, int height){
     /* This function is used to convert a point (x,y) to pixel coordinates
-     * on a screen with viewing region [minx,maxx]x[miny,maxy]
+     * on a width x height screen with viewing region [minx,maxx]x[miny,maxy]
      */
-    coords[0] = (int)(WIDTH/2  + WIDTH/2  * ((x - minx)/(maxx - minx)*2 - 1));
-    coords[1] = (int)(HEIGHT/2 - HEIGHT/2 * ((y - miny)/(maxy - miny)*2 - 1));
+    coords[0] = (int)(width/2  + width/2  * ((x - minx)/(maxx - minx)*2 - 1));
+    coords[1] = (int)(height/2 - height/2 * ((y - miny)/(maxy - miny)*2 - 1));
 }
 
-void generatematrix(struct Fractal *frac, double *window){
-    /* This function is used to transform the points of a fractal
-     * to a matrix of size HEIGHT x WIDTH which will be used to
-     * generate an image of the fractal.
+void clearmatrix(struct Fractal *frac){
+    /* This function starts the matrix of a fractal off as a fully
+     * white image and resets the pixel statistics
+     */
+    bmclear(&frac -> bm);
+    if (frac -> supersample > 1) bmclear(&frac -> ssbm);
+    frac -> numb = 0;
+    frac -> sumx = 0;
+    frac -> sumy = 0;
+    frac -> sumxx = 0;
+    frac -> sumyy = 0;
+    frac -> sumxy = 0;
+}
+
+void stamppixels(struct Fractal *frac, int *pixx, int *pixy, int *colours, int n){
+    /* This function is used to draw n points of a fractal onto its
+     * matrix, given as pixel coordinates (see stamppoints). Pixels
+     * that are drawn on for the first time are added to the pixel
+     * count and the coordinate sums of the fractal. When
+     * supersampling the points go to the subpixel counts and the
+     * statistics are made in finishmatrix instead.
      */
     int i,j,k,x,y;
     int dotsize = DOTSIZE; //positive odd integer - defines the size of a point
-    int white = 255;
-    int **bm = frac -> bm;
-    
-    //start off with a fully white image
-    for (i = 0; i < HEIGHT; i++){
-        for (j = 0; j < WIDTH; j++){
-            bm[i][j] = white;
-        }
-    }
+    struct Bitmap *bm = (frac -> supersample > 1) ? &frac -> ssbm : &frac -> bm;
+    int width  = bm -> width;
+    int height = bm -> height;
     //numb is the number of pixels corresponding to the attractor
-    //avgx and avgy are the pixel centroid coordinates
-    int numb = 0;
-    int avgx = 0;
-    int avgy = 0;
-    int *coords = ivecmem(2);
-    for (i = 0; i < frac -> numpoints; i++){
-	pointtocoord(coords, frac ->xs[i], frac->ys[i], window[0], 
-                              window[1], window[2], window[3]);
-        x = coords[0];
-        y = coords[1];
+    //sumx and sumy are the sums of their pixel coordinates, and
+    //sumxx, sumyy and sumxy of their squares and products
+    int numb = frac -> numb;
+    long long sumx = frac -> sumx;
+    long long sumy = frac -> sumy;
+    long long sumxx = frac -> sumxx;
+    long long sumyy = frac -> sumyy;
+    long long sumxy = frac -> sumxy;
+    for (i = 0; i < n; i++){
+        x = pixx[i];
+        y = pixy[i];
         if (dotsize %2 != 0) {
              for (j = -1 * (dotsize -1)/2; j <= (dotsize - 1)/2; j++){
                  for (k = -1 * (dotsize -1)/2; k <= (dotsize -1)/2; k++){
-                     if (x >= WIDTH  - dotsize/2 - 1) x = WIDTH  - dotsize/2 - 1;
-                     if (y >= HEIGHT - dotsize/2 - 1) y = HEIGHT - dotsize/2 - 1;
+                     if (x >= width  - dotsize/2 - 1) x = width  - dotsize/2 - 1;
+                     if (y >= height - dotsize/2 - 1) y = height - dotsize/2 - 1;
                      if (x <= dotsize/2) x = dotsize;
                      if (y <= dotsize/2) y = dotsize;
-                     if (bm[y+j][x+k] == 255){
-                         avgx += x+k;
-                         avgy += y+j;
+                     if (bmstamp(bm, x+k, y+j, colours[i])){
+                         long long px = x+k, py = y+j;
+                         sumx  += px;
+                         sumy  += py;
+                         sumxx += px*px;
+                         sumyy += py*py;
+                         sumxy += px*py;
                          numb += 1;
                      }
-                     bm[y+j][x+k] = frac -> colours[i];
                 }
             }
         }
     }
-    frac -> avgx = avgx/(int)numb;
-    frac -> avgy = avgy/(int)numb;
     frac -> numb = numb;
-    free(coords);
+    frac -> sumx = sumx;
+    frac -> sumy = sumy;
+    frac -> sumxx = sumxx;
+    frac -> sumyy = sumyy;
+    frac -> sumxy = sumxy;
+}
+
+void stamppoints(struct Fractal *frac, double *window, double *xs, double *ys, int *colours, int n){
+    /* This function is used to draw n points of a fractal onto its
+     * matrix. They are turned into pixel coordinates ORBITBATCH at a
+     * time and drawn by stamppixels.
+     */
+    struct Bitmap *bm = (frac -> supersample > 1) ? &frac -> ssbm : &frac -> bm;
+    int pixx[ORBITBATCH], pixy[ORBITBATCH], coords[2];
+    int i, j, m;
+    for (i = 0; i < n; i += m){
+        m = (n - i < ORBITBATCH) ? n - i : ORBITBATCH;
+        for (j = 0; j < m; j++){
+            pointtocoord(coords, xs[i+j], ys[i+j], window[0],
+                         window[1], window[2], window[3], bm -> width, bm -> height);
+            pixx[j] = coords[0];
+            pixy[j] = coords[1];
+        }
+        stamppixels(frac, pixx, pixy, colours + i, m);
+    }
+}
+
+void finishmatrix(struct Fractal *frac){
+    /* This function computes the pixel centroid of a fractal
+     * once all of its points have been drawn. When supersampling,
+     * each pixel is first set to the number of its subpixels that
+     * were hit, and the pixel statistics are made from the result.
+     */
+    if (frac -> supersample > 1){
+        struct Bitmap *bm = &frac -> bm;
+        int x, y;
+        long long sumx = 0, sumy = 0, sumxx = 0, sumyy = 0, sumxy = 0;
+        int numb = 0;
+        bmdownsample(bm, &frac -> ssbm, frac -> supersample);
+        for (y = 0; y < bm -> height; y++){
+            for (x = 0; x < bm -> width; x++){
+                if (bmget(bm, x, y) != 0){
+                    sumx  += x;
+                    sumy  += y;
+                    sumxx += (long long)x * x;
+                    sumyy += (long long)y * y;
+                    sumxy += (long long)x * y;
+                    numb  += 1;
+                }
+            }
+        }
+        frac -> numb  = numb;
+        frac -> sumx  = sumx;
+        frac -> sumy  = sumy;
+        frac -> sumxx = sumxx;
+        frac -> sumyy = sumyy;
+        frac -> sumxy = sumxy;
+    }
+    if (frac -> numb > 0){
+        frac -> avgx = (double)frac -> sumx/frac -> numb;
+        frac -> avgy = (double)frac -> sumy/frac -> numb;
+    }
+}
+
+void generatematrix(struct Fractal *frac, double *window){
+    /* This function is used to transform the points of a fractal
+     * to its pixel map (frac -> bm) which will be used to
+     * generate an image of the fractal.
+     */
+    clearmatrix(frac);
+    stamppoints(frac, window, frac -> xs, frac -> ys, frac -> colours, frac -> numpoints);
+    finishmatrix(frac);
     return;
 }
 
+void generatestream(struct Fractal *frac, double *window, double *extrema){
+    /* This function generates a fractal without keeping its points.
+     * The points are generated ORBITBATCH at a time into a small
+     * buffer and drawn onto the matrix straight away, while the
+     * extrema and pixel statistics are kept up to date. It draws
+     * exactly the same picture as generatepoints followed by
+     * generatematrix, without the numpoints sized buffers or the
+     * second pass over them.
+     *
+     * If frac -> adaptwindow is set the game stops early once the
+     * picture has stopped filling in: when, after minpoints points,
+     * a window of adaptwindow points covers fewer than adaptrate
+     * new pixels per point. The points drawn are kept in pointsused.
+     *
+     * With ENGINE_IFS the picture is drawn by generateifs instead.
+     * The walkers of a PREC_FLOAT fractal are drawn from their float
+     * lanes by floatcoords, without being widened to double
+     */
+    double xs[ORBITBATCH], ys[ORBITBATCH];
+    float fx[ORBITBATCH], fy[ORBITBATCH];
+    int colours[ORBITBATCH], pixx[ORBITBATCH], pixy[ORBITBATCH];
+    struct Bitmap *bm = (frac -> supersample > 1) ? &frac -> ssbm : &frac -> bm;
+    int floatlanes = (frac -> engine == ENGINE_SIMD && frac -> precision == PREC_FLOAT);
+    int i, n;
+    int checkat = frac -> adaptwindow; //when to next look at the coverage
+    int lastnumb = 0, lasti = 0;
+    if (frac -> engine == ENGINE_IFS){
+        generateifs(frac, window, extrema);
+        return;
+    }
+    clearmatrix(frac);
+    startorbit(frac);
+    extrema[0] = extrema[1] = extrema[2] = extrema[3] = 0;
+    for (i = 0; i < frac -> numpoints; i += n){
+        n = frac -> numpoints - i;
+        if (n > ORBITBATCH) n = ORBITBATCH;
+        if (floatlanes){
+            walkerpointsf(frac, fx, fy, colours, n);
+            floatcoords(fx, fy, n, window, bm -> width, bm -> height, pixx, pixy, extrema, i == 0);
+            stamppixels(frac, pixx, pixy, colours, n);
+        }
+        else {
+            orbitpoints(frac, xs, ys, colours, n);
+            updateextrema(extrema, xs, ys, n, i == 0);
+            stamppoints(frac, window, xs, ys, colours, n);
+        }
+        if (frac -> adaptwindow > 0 && i + n >= checkat){
+            if (i + n >= frac -> minpoints && frac -> numb - lastnumb < frac -> adaptrate * (i + n - lasti)){
+                i += n;
+                break;
+            }
+            lastnumb = frac -> numb;
+            lasti    = i + n;
+            checkat  = i + n + frac -> adaptwindow;
+        }
+    }
+    frac -> pointsused = i;
+    finishmatrix(frac);
+}
+
 void freegenome(struct Fractal *frac){
     /* This function frees the genome memory */
     free(frac -> genome[0]);
@@ -406,7 +790,12 @@ void freegenome(struct Fractal *frac){
 void freefrac(struct Fractal *frac){
     /* This function frees the memory of a fractal structure */
     freegenome(frac);
-    ifreemat(HEIGHT, frac -> bm);
+    free(frac -> params);
+    free(frac -> fparams);
+    free(frac -> thresh);
+    bmfree(&frac -> bm);
+    //free(NULL) is fine for streamed fractals and unused subpixel maps
+    bmfree(&frac -> ssbm);
     free(frac -> xs);
     free(frac -> ys);
     free(frac -> colours);
@@ -3,27 +3,104 @@
  *
  * FILE NAME: Fractals.h
  */
-#define HEIGHT 640
+#include <stdint.h>
+#include "fracrand.h"
+#include "bitmap.h"
+#define HEIGHT 640 //default resolution, see FracConfig
 #define WIDTH 640
+#define WALKERS 8 //number of orbits run side by side by the simd engine
+
+#define ENGINE_SCALAR 0 //one orbit, see orbitpoints
+#define ENGINE_SIMD   1 //WALKERS orbits in simd lanes, see chaossimd.c
+#define ENGINE_IFS    2 //no orbit, the invariant measure is worked out, see ifsrender.c
+
+#define PREC_DOUBLE 0 //the walkers' arithmetic, see chaossimd.c
+#define PREC_FLOAT  1 //32 bit floats
 
 struct Fractal{
-        double dimension, stddevx, stddevy, *xs, *ys, **genome;
-        int fracnum, numfuncs, numpoints, numb, dist, avgx, avgy, **bm, *colours, coloured;
+        double dimension, avgx, avgy, stddevx, stddevy, *xs, *ys, **genome;
+        int fracnum, numfuncs, numpoints, numb, dist, *colours, coloured;
+        struct Bitmap bm;      //the picture of the fractal, see bitmap.h
+        int supersample;       //subpixels per pixel across, see FracConfig
+        int pointsused;        //points actually drawn, see generatestream
+        int adaptwindow, minpoints; //the adaptive point budget, see FracConfig
+        double adaptrate;
+        struct Bitmap ssbm;    //hit counts of the subpixels, if supersample > 1
+        uint64_t seed;   //the seed the fractal was generated from
+        struct Rand rng; //the random stream of the fractal
+        int stream;      //if nonzero the points are drawn as they are generated
+                         //and xs, ys and colours are not allocated
+        double orbitx, orbity; //the current point of the chaos game
+        long long sumx, sumy;  //sums of the pixel coordinates
+        long long sumxx, sumyy, sumxy; //and of their squares and products
+        double covxy;          //covariance of the pixel coordinates
+        double orientation;    //angle of the major axis of the pixels, see stddev
+        double corrdim;        //correlation dimension, -1 unless corrdimension was called
+        double window[4];      //the viewing window the fractal was drawn in
+        int engine;            //ENGINE_SCALAR, ENGINE_SIMD or ENGINE_IFS
+        int converged;         //0 if generateifs gave up before the measure settled,
+                               //so the picture may be missing pixels
+        double *params;        //the genome packed as a[], b[], c[], d[], e[], f[]
+        int precision;         //PREC_DOUBLE or PREC_FLOAT
+        float *fparams;        //params as floats, for PREC_FLOAT
+        uint32_t *thresh;      //cumulative probabilities scaled to 32 bits
+        long multtries;        //tries generatemults has taken for this fractal
+        int capfuncs, cappoints; //functions and points there is room for, see resetfrac
+        double walkx[WALKERS], walky[WALKERS]; //the current points of the walkers
+        struct Rand walkrng[WALKERS];          //the random streams of the walkers
 };
 
+struct FracConfig{
+        /* Everything besides the seed that determines a fractal */
+        int numfuncs, numpoints, cutoff;
+        double window[4];
+        int stream;
+        int autofit;     //if nonzero each fractal gets its own tight window
+        int engine;
+        int width, height;     //resolution of the picture
+        int pixtype, layout;   //see bitmap.h
+        int supersample;       //if above 1, points are drawn on supersample x
+                               //supersample subpixels per pixel and the pixels
+                               //count the subpixels hit, see finishmatrix
+        int adaptwindow;       //if nonzero, a streamed fractal stops early once
+        double adaptrate;      //fewer than adaptrate new pixels per point were
+        int minpoints;         //covered over the last adaptwindow points, after
+                               //at least minpoints points (numpoints is the cap)
+        int precision;         //arithmetic of the simd engine's walkers, PREC_DOUBLE,
+                               //or PREC_FLOAT (other engines use double)
+};
+
+void defaultconfig(struct FracConfig *cfg, int numfuncs, int numpoints);
+
 void func(double *x, double *y, double **genome, int funcnum);
-double validranddouble(void);
-void generatemults(double **genome, int *multparams);
-void generateadds(double **genome, int *addparams);
+double validranddouble(struct Rand *rng);
+int generatemults(double **genome, int *multparams, struct Rand *rng);
+void generateadds(double **genome, int *addparams, struct Rand *rng);
 void generategenome(struct Fractal *frac);
 void ordergenome(int numfuncs, double **genome);
 double validatefunc(double a, double b, double c, double d);
 double ** mallocgenome(int numfuncs);
+void initfrac(struct Fractal *frac, struct FracConfig *cfg);
+void resetfrac(struct Fractal *frac, struct FracConfig *cfg);
 void initializefrac(struct Fractal *frac, int numfuncs, int numpoints);
+void packgenome(struct Fractal *frac);
+void startorbit(struct Fractal *frac);
+void selectfuncs(struct Fractal *frac, struct Rand *rng, int *funcs, int n, int stride);
+void orbitpoints(struct Fractal *frac, double *xs, double *ys, int *colours, int n);
+void updateextrema(double *extrema, double *xs, double *ys, int n, int first);
 void generatepoints(struct Fractal *frac, double *extrema);
+int fixedpointsinside(struct Fractal *frac, double *window);
+void pilotorbit(struct Fractal *frac, double *extrema, int n);
+int insidewindow(double *extrema, double *window);
+void fitwindow(double *window, double *extrema, double margin);
 void generatefrac(struct Fractal *frac, double *extrema);
-void pointtocoord(int *coords, double x, double y, double minx, double maxx, double miny, double maxy);
+void pointtocoord(int *coords, double x, double y, double minx, double maxx, double miny, double maxy, int width, int height);
+void clearmatrix(struct Fractal *frac);
+void stamppixels(struct Fractal *frac, int *pixx, int *pixy, int *colours, int n);
+void stamppoints(struct Fractal *frac, double *window, double *xs, double *ys, int *colours, int n);
+void finishmatrix(struct Fractal *frac);
 void generatematrix(struct Fractal *frac, double *window);
+void generatestream(struct Fractal *frac, double *window, double *extrema);
 void freegenome(struct Fractal *frac);
 void freefrac(struct Fractal *frac);
 int lenfile(char *filename);
@@ -6,13 +6,15 @@
  * This file contains functions that are used to 
  * for fractal image input and output. Specifically,
  * to convert pixel maps of fractals to a png, either
- * coloured or not
+ * coloured or not, and to read a png back as a bit map
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <png.h>
 #include <math.h>
+#include <string.h>
+#include <zlib.h>
 #include "PNGio.h"
 #include "Fractals.h"
 
@@ -26,8 +28,12 @@ void funcnumtocolours(int colour, int *r, int *g, int *b){
      *           2:    yellow
      *           3:    green
      *           4:    blue
+     *           5:    purple
+     *           6:    pink
+     *           7:    brown
      * add more colours if you want to colour an attractor
-     * that has more than 4 functions in its IFS
+     * that has more than 8 functions in its IFS, other
+     * functions are grey
      */
 
     if (colour == 0){
@@ -55,9 +61,83 @@ void funcnumtocolours(int colour, int *r, int *g, int *b){
         *g = 128;
         *b = 255;
     }
+    else if (colour == 5){
+        *r = 128;
+        *g = 0;
+        *b = 255;
+    }
+    else if (colour == 6){
+        *r = 255;
+        *g = 0;
+        *b = 255;
+    }
+    else if (colour == 7){
+        *r = 128;
+        *g = 64;
+        *b = 0;
+    }
+    else {
+        *r = 128;
+        *g = 128;
+        *b = 128;
+    }
     return;
 }
 
+static int pnglevel   = Z_DEFAULT_COMPRESSION;
+static int pngfilters = PNG_NO_FILTERS;
+static int pngstrategy = Z_DEFAULT_STRATEGY;
+
+void setpngoptions(int level, int filters, int strategy){
+    /* This function sets the zlib compression level (0-9, or -1 for
+     * zlib's default), the png row filters (PNG_FILTER_* flags, or
+     * PNG_ALL_FILTERS) and the zlib strategy (Z_DEFAULT_STRATEGY,
+     * Z_FILTERED, Z_RLE, ...) used by WritePNG. It should be called
+     * before any threads start writing pngs.
+     *
+     * The defaults use no row filters, which is best for bilevel
+     * and palette images.
+     */
+    pnglevel    = level;
+    pngfilters  = filters;
+    pngstrategy = strategy;
+}
+
+static int tonemap = TONE_LOG;
+static double tonegamma = 2.2;
+static int tonedepth = 8;
+
+void settonemap(int tone, double gamma, int depth){
+    /* This function sets how WritePNG turns hit counts (PIX_U16 and
+     * PIX_U32 pixel maps) into gray: TONE_LOG scales log(1 + count)
+     * and TONE_GAMMA scales count^(1/gamma), both so that the most
+     * hit pixel is black and empty pixels are white, in 8 or 16 bit
+     * grayscale (depth). It should be called before any threads
+     * start writing pngs.
+     */
+    tonemap   = tone;
+    tonegamma = (gamma > 0) ? gamma : 1;
+    tonedepth = (depth == 16) ? 16 : 8;
+}
+
+static png_bytep pngrow(size_t size){
+    /* This function returns a row buffer of at least size bytes. The
+     * buffer belongs to the calling thread and is reused by every
+     * WritePNG call made from it.
+     */
+    static __thread png_bytep row = NULL;
+    static __thread size_t rowsize = 0;
+    if (size > rowsize){
+        free(row);
+        if ((row = (png_bytep)malloc(size)) == NULL){
+            fprintf(stderr, "Malloc failed. (WritePNG)\n");
+            exit(1);
+        }
+        rowsize = size;
+    }
+    return row;
+}
+
 void WritePNG(char *filename, struct Fractal *frac){
     /* This function converts a pixel map of a fractal,
      * stored in the fractal structure, to a png image
@@ -67,8 +147,38 @@ void WritePNG(char *filename, struct Fractal *frac){
      * named coloured, if coloured is 0, the fractal is 
      * coloured based on which function output what point
      * according to the colours assigned in funcnumtocolours.
-     * If coloured is 1 then the fractal is black.
+     * If coloured is 1 then the fractal is black. Only pixel
+     * maps that store function numbers (PIX_U8) can be coloured.
+     *
+     * Black fractals are written as 1 bit grayscale images and
+     * coloured ones as palette images with one entry per function.
+     * Hit count maps are tone mapped to 8 or 16 bit grayscale (see
+     * settonemap), and supersampled ones are shaded by the share of
+     * each pixel the attractor covers. The image is written one row at a time from a
+     * reused buffer.
      */
+    int i, j, r, g, b;
+    int width  = frac -> bm.width;
+    int height = frac -> bm.height;
+    int palette = (frac -> coloured == 0 && frac -> bm.pixtype == PIX_U8);
+    int density = (frac -> bm.pixtype == PIX_U16 || frac -> bm.pixtype == PIX_U32);
+    int depth   = palette ? 8 : (density ? tonedepth : 1);
+    double scale = 0;
+    if (density && frac -> supersample > 1){
+        /* the pixels count covered subpixels, so are shaded linearly */
+        scale = 1.0/(frac -> supersample * frac -> supersample);
+    }
+    else if (density){
+        /* scale takes the tone of the most hit pixel to 1 */
+        uint32_t most = 0;
+        for (i = 0; i < height; i++){
+            for (j = 0; j < width; j++){
+                uint32_t v = bmget(&frac -> bm, j, i);
+                if (v > most) most = v;
+            }
+        }
+        if (most > 0) scale = (tonemap == TONE_LOG) ? 1/log1p((double)most) : 1/pow((double)most, 1/tonegamma);
+    }
     FILE *fp = fopen(filename, "wb");
     if (!fp) abort();
     png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
@@ -77,46 +187,123 @@ void WritePNG(char *filename, struct Fractal *frac){
     if (!info) abort();
     if (setjmp(png_jmpbuf(png))) abort();
     png_init_io(png, fp);
+    png_set_compression_level(png, pnglevel);
+    png_set_compression_strategy(png, pngstrategy);
+    png_set_filter(png, PNG_FILTER_TYPE_BASE, pngfilters);
     png_set_IHDR(
         png, 
         info, 
-        WIDTH, 
-        HEIGHT, 
-        8, 
-        PNG_COLOR_TYPE_RGB, 
+        width, 
+        height, 
+        depth, 
+        palette ? PNG_COLOR_TYPE_PALETTE : PNG_COLOR_TYPE_GRAY, 
         PNG_INTERLACE_NONE, 
         PNG_COMPRESSION_TYPE_DEFAULT, 
         PNG_FILTER_TYPE_DEFAULT
     );
+    if (palette){
+        /* entry 0 is white, entry k + 1 is the colour of function k */
+        png_color colours[256];
+        int numcolours = frac -> numfuncs + 1;
+        colours[0].red = colours[0].green = colours[0].blue = 255;
+        for (i = 1; i < numcolours; i++){
+            funcnumtocolours(i - 1, &r, &g, &b);
+            colours[i].red   = (png_byte)r;
+            colours[i].green = (png_byte)g;
+            colours[i].blue  = (png_byte)b;
+        }
+        png_set_PLTE(png, info, colours, numcolours);
+    }
     png_write_info(png, info); 
-    png_bytep *row_pointers = (png_bytep *)malloc(HEIGHT * sizeof(png_bytep));
-    for (int i = 0; i < HEIGHT; i++){
-        row_pointers[i] = (png_bytep)malloc(3 * WIDTH * sizeof(unsigned char));
-    }
-    int r,g,b;
-    for (int i = 0; i < HEIGHT; i++){
-        for (int j = 0; j < WIDTH; j++){
-            if (frac -> bm[i][j] != 255 && frac -> coloured == 0){
-                funcnumtocolours(frac -> bm[i][j], &r, &g, &b);
-                row_pointers[i][3*j+0] = (unsigned char) r;
-                row_pointers[i][3*j+1] = (unsigned char) g;
-                row_pointers[i][3*j+2] = (unsigned char) b;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (!palette && frac -> bm.pixtype == PIX_BIT){
+        /* The rows of a bit map are already 1 bit pixels, leftmost in
+         * the low bit and 1 on the attractor, so libpng is told to
+         * swap the bit order and invert them and is given the rows as
+         * they are */
+        png_set_packswap(png);
+        png_set_invert_mono(png);
+        for (i = 0; i < height; i++){
+            png_write_row(png, (png_bytep)((uint64_t *)frac -> bm.data + (size_t)i * frac -> bm.stride));
+        }
+        png_write_end(png, NULL);
+        fclose(fp);
+        png_destroy_write_struct(&png, &info);
+        return;
+    }
+#endif
+    png_bytep row = pngrow(((size_t)width * depth + 7)/8);
+    for (i = 0; i < height; i++){
+        if (density){
+            /* gray levels, big endian when 16 bit, white where empty */
+            int maxgray = (1 << depth) - 1;
+            for (j = 0; j < width; j++){
+                uint32_t v = bmget(&frac -> bm, j, i);
+                double tone = 0;
+                if (v != 0 && frac -> supersample > 1) tone = scale * v;
+                else if (v != 0) tone = scale * ((tonemap == TONE_LOG) ? log1p((double)v) : pow((double)v, 1/tonegamma));
+                int gray = maxgray - (int)(tone * maxgray + 0.5);
+                if (depth == 16){
+                    row[2*j]     = (png_byte)(gray >> 8);
+                    row[2*j + 1] = (png_byte)(gray & 0xff);
+                }
+                else {
+                    row[j] = (png_byte)gray;
+                }
             }
-            else if (frac -> bm[i][j] != 255 && frac -> coloured == 1){
-                row_pointers[i][3*j+0] = (unsigned char) 0;
-                                row_pointers[i][3*j+1] = (unsigned char) 0;
-                                row_pointers[i][3*j+2] = (unsigned char) 0;
+        }
+        else if (palette){
+            for (j = 0; j < width; j++){
+                row[j] = (png_byte)bmget(&frac -> bm, j, i);
             }
-            else {
-                row_pointers[i][3*j+0] = (unsigned char) 255;
-                row_pointers[i][3*j+1] = (unsigned char) 255;
-                row_pointers[i][3*j+2] = (unsigned char) 255;
+        }
+        else {
+            /* 1 bit pixels, leftmost in the high bit, 0 is black */
+            memset(row, 0xff, (width + 7)/8);
+            for (j = 0; j < width; j++){
+                if (bmget(&frac -> bm, j, i) != 0) row[j >> 3] &= (png_byte)~(0x80 >> (j & 7));
             }
         }
+        png_write_row(png, row);
     }
-    png_write_image(png, row_pointers);
     png_write_end(png, NULL);
     fclose(fp);
     if (png && info) png_destroy_write_struct(&png, &info);
     return;
 }
+
+int ReadPNGmask(char *filename, struct Bitmap *bm){
+    /* This function reads a png written by WritePNG (or any other)
+     * into a bit map, setting the pixels that are not white, ie. the
+     * attractor whether the png is black, coloured or gray. bm is
+     * made the size of the png. It returns -1 if the png can not be
+     * read
+     */
+    png_image image;
+    png_bytep gray;
+    int x, y;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    if (!png_image_begin_read_from_file(&image, filename)) return -1;
+    image.format = PNG_FORMAT_GRAY;
+    if ((gray = (png_bytep)malloc(PNG_IMAGE_SIZE(image))) == NULL){
+        fprintf(stderr, "Malloc failed. (ReadPNGmask)\n");
+        exit(1);
+    }
+    if (!png_image_finish_read(&image, NULL, gray, 0, NULL)){
+        png_image_free(&image);
+        free(gray);
+        return -1;
+    }
+    bmreshape(bm, image.width, image.height, PIX_BIT, LAYOUT_ROWS);
+    bmclear(bm);
+    for (y = 0; y < (int)image.height; y++){
+        png_bytep row = gray + (size_t)y * image.width;
+        uint64_t *words = (uint64_t *)bm -> data + (size_t)y * bm -> stride;
+        for (x = 0; x < (int)image.width; x++){
+            if (row[x] != 255) words[x >> 6] |= 1ULL << (x & 63);
+        }
+    }
+    free(gray);
+    return 0;
+}
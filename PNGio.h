@@ -5,6 +5,13 @@
  * FILE NAME: PNGio.h
  */
 
+#define TONE_LOG   0 //how hit counts are mapped to gray, see settonemap
+#define TONE_GAMMA 1
+
 struct Fractal;
+struct Bitmap;
 void funcnumtocolours(int colour, int *r, int *g, int *b);
+void setpngoptions(int level, int filters, int strategy);
+void settonemap(int tone, double gamma, int depth);
 void WritePNG(char *filename, struct Fractal *frac);
+int ReadPNGmask(char *filename, struct Bitmap *bm);
@@ -0,0 +1,335 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: bench.c
+ *
+ * Microbenchmarks of the steps used to generate a fractal:
+ * generategenome,
+ * generatepoints (both engines), generatestream (also in float),
+ * drawing float points with and without widening them, generateifs, collagescore, generatematrix, stddev/dimension
+ * and WritePNG. Every timing is the median of several runs after
+ * warmup runs, with fixed seeds, and the results are written as
+ * JSON so runs can be compared across changes, eg.
+ *
+ *      ./bench --out bench.json
+ *      ./bench --quick
+ *
+ * The sweeps are numfuncs 2-8, numpoints 1e4-1e7 (1e6 with
+ * --quick) and resolutions 160-1280.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "Fractals.h"
+#include "fracfuncs.h"
+#include "PNGio.h"
+#include "chaossimd.h"
+#include "ifsrender.h"
+#include "collage.h"
+
+#define BENCHSEED 20200601ULL
+#define MAXREPS 101
+
+struct Bench{
+    FILE *out;
+    int warmup, reps, first;
+    char pngfile[256];
+};
+
+static double now(void){
+    /* This function returns a monotonic time in seconds */
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int cmpdouble(const void *a, const void *b){
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double *times, int n){
+    /* This function returns the median of n times (it sorts them) */
+    qsort(times, n, sizeof(double), cmpdouble);
+    if (n % 2 == 1) return times[n/2];
+    return (times[n/2 - 1] + times[n/2])/2;
+}
+
+static void report(struct Bench *b, const char *name, const char *engine, int numfuncs, int numpoints,
+                   int width, double seconds, double items, const char *extra){
+    /* This function writes one result as a JSON object. items is the
+     * number of things (points, genomes, pixels) done per run, and
+     * extra is any further "key": value pairs, or NULL
+     */
+    fprintf(b -> out, "%s\n    {\"bench\": \"%s\", \"engine\": \"%s\", \"numfuncs\": %d, \"numpoints\": %d, "
+            "\"resolution\": %d, \"median_s\": %.9f, \"per_s\": %.1f%s%s}",
+            b -> first ? "" : ",", name, engine, numfuncs, numpoints, width, seconds,
+            seconds > 0 ? items/seconds : 0.0, extra ? ", " : "", extra ? extra : "");
+    b -> first = 0;
+    fflush(b -> out);
+}
+
+static struct Fractal * benchfrac(int numfuncs, int numpoints, int width, int engine, int stream){
+    /* This function makes a fractal with a fixed seed whose attractor
+     * lies in the default window, with its genome generated but no
+     * points yet
+     */
+    struct FracConfig cfg;
+    struct Fractal *frac;
+    double extrema[4];
+    defaultconfig(&cfg, numfuncs, numpoints);
+    cfg.width  = width;
+    cfg.height = width;
+    cfg.engine = engine;
+    cfg.stream = stream;
+    if ((frac = (struct Fractal *)malloc(sizeof(struct Fractal))) == NULL){
+        fprintf(stderr, "Malloc failed. (bench)\n");
+        exit(1);
+    }
+    initfrac(frac, &cfg);
+    seedrand(&frac -> rng, BENCHSEED + numfuncs);
+    do {
+        generategenome(frac);
+        pilotorbit(frac, extrema, 2000);
+    } while (fixedpointsinside(frac, cfg.window) == 0 || insidewindow(extrema, cfg.window) == 0);
+    return frac;
+}
+
+static void benchgenome(struct Bench *b, int numfuncs){
+    /* generategenome, with the number of rejected matrices per function */
+    int count = 2000;
+    double times[MAXREPS];
+    struct Fractal *frac = benchfrac(numfuncs, 1, 8, ENGINE_SCALAR, 1);
+    char extra[64];
+    for (int r = -b -> warmup; r < b -> reps; r++){
+        seedrand(&frac -> rng, BENCHSEED);
+        frac -> multtries = 0;
+        double t = now();
+        for (int i = 0; i < count; i++) generategenome(frac);
+        t = now() - t;
+        if (r >= 0) times[r] = t;
+    }
+    sprintf(extra, "\"rejects_per_func\": %.4f", (double)frac -> multtries/(count * numfuncs) - 1);
+    report(b, "generategenome", "scalar", numfuncs, 0, 0, median(times, b -> reps)/count, 1, extra);
+    freefrac(frac);
+}
+
+static void benchpoints(struct Bench *b, int numfuncs, int numpoints, int engine){
+    /* generatepoints */
+    double times[MAXREPS], extrema[4];
+    struct Fractal *frac = benchfrac(numfuncs, numpoints, WIDTH, engine, 0);
+    for (int r = -b -> warmup; r < b -> reps; r++){
+        double t = now();
+        generatepoints(frac, extrema);
+        t = now() - t;
+        if (r >= 0) times[r] = t;
+    }
+    report(b, "generatepoints", engine == ENGINE_SIMD ? simdisaname(simdisa()) : "scalar",
+           numfuncs, numpoints, 0, median(times, b -> reps), numpoints, NULL);
+    freefrac(frac);
+}
+
+static void benchstream(struct Bench *b, int numfuncs, int numpoints, int width, int engine, int precision){
+    /* generatestream, ie. points drawn as they are generated, with the
+     * simd walkers in the given precision */
+    double times[MAXREPS], extrema[4];
+    char name[64];
+    struct Fractal *frac = benchfrac(numfuncs, numpoints, width, engine, 1);
+    frac -> precision = precision; //packed with the genome by generatestream
+    for (int r = -b -> warmup; r < b -> reps; r++){
+        double t = now();
+        generatestream(frac, frac -> window, extrema);
+        t = now() - t;
+        if (r >= 0) times[r] = t;
+    }
+    snprintf(name, sizeof(name), "%s%s", engine == ENGINE_SIMD ? simdisaname(simdisa()) : "scalar",
+             precision == PREC_FLOAT ? "-float" : "");
+    report(b, "generatestream", name, numfuncs, numpoints, width, median(times, b -> reps), numpoints, NULL);
+    freefrac(frac);
+}
+
+static void benchstampfloat(struct Bench *b, int numpoints, int width, int widen){
+    /* drawing the float walkers' points, either widened to double and
+     * drawn by stamppoints (widen) or drawn from the float lanes by
+     * floatcoords and stamppixels, as generatestream does */
+    double times[MAXREPS], extrema[4], xs[256], ys[256];
+    int pixx[256], pixy[256], *colours;
+    float *fx, *fy;
+    struct Fractal *frac = benchfrac(4, numpoints, width, ENGINE_SIMD, 1);
+    if ((fx = (float *)malloc(numpoints * sizeof(float))) == NULL ||
+        (fy = (float *)malloc(numpoints * sizeof(float))) == NULL ||
+        (colours = (int *)malloc(numpoints * sizeof(int))) == NULL){
+        fprintf(stderr, "Malloc failed. (bench)\n");
+        exit(1);
+    }
+    frac -> precision = PREC_FLOAT;
+    packgenome(frac);
+    startwalkers(frac);
+    walkerpointsf(frac, fx, fy, colours, numpoints);
+    for (int r = -b -> warmup; r < b -> reps; r++){
+        clearmatrix(frac);
+        double t = now();
+        for (int i = 0; i < numpoints; i += 256){
+            int n = (numpoints - i < 256) ? numpoints - i : 256;
+            if (widen){
+                for (int j = 0; j < n; j++){
+                    xs[j] = fx[i+j];
+                    ys[j] = fy[i+j];
+                }
+                updateextrema(extrema, xs, ys, n, i == 0);
+                stamppoints(frac, frac -> window, xs, ys, colours + i, n);
+            }
+            else {
+                floatcoords(fx + i, fy + i, n, frac -> window, width, width, pixx, pixy, extrema, i == 0);
+                stamppixels(frac, pixx, pixy, colours + i, n);
+            }
+        }
+        t = now() - t;
+        if (r >= 0) times[r] = t;
+    }
+    report(b, "stampfloat", widen ? "widened" : simdisaname(simdisa()), 4, numpoints, width,
+           median(times, b -> reps), numpoints, NULL);
+    free(fx);
+    free(fy);
+    free(colours);
+    freefrac(frac);
+}
+
+static void benchifs(struct Bench *b, int numfuncs, int width){
+    /* generateifs, with the pixels mapped (pointsused) as the items */
+    double times[MAXREPS], extrema[4];
+    char extra[64];
+    struct Fractal *frac = benchfrac(numfuncs, 1, width, ENGINE_IFS, 1);
+    for (int r = -b -> warmup; r < b -> reps; r++){
+        double t = now();
+        generateifs(frac, frac -> window, extrema);
+        t = now() - t;
+        if (r >= 0) times[r] = t;
+    }
+    sprintf(extra, "\"numb\": %d", frac -> numb);
+    report(b, "generateifs", "ifs", numfuncs, 0, width, median(times, b -> reps), frac -> pointsused, extra);
+    freefrac(frac);
+}
+
+static void benchcollage(struct Bench *b, int numfuncs, int width){
+    /* collagescore of a fractal's genome on its own picture, with the
+     * genomes scored as the items */
+    double times[MAXREPS], extrema[4], *params;
+    char extra[64];
+    struct Score score;
+    struct Fractal *frac = benchfrac(numfuncs, 100000, width, ENGINE_SCALAR, 1);
+    generatestream(frac, frac -> window, extrema);
+    packgenome(frac);
+    if ((params = (double *)malloc(6 * numfuncs * sizeof(double))) == NULL){
+        fprintf(stderr, "Malloc failed. (bench)\n");
+        exit(1);
+    }
+    memcpy(params, frac -> genome[0], 4 * numfuncs * sizeof(double));
+    memcpy(params + 4 * numfuncs, frac -> genome[1], 2 * numfuncs * sizeof(double));
+    for (int r = -b -> warmup; r < b -> reps; r++){
+        double t = now();
+        collagescore(params, numfuncs, frac -> window, &frac -> bm, &score);
+        t = now() - t;
+        if (r >= 0) times[r] = t;
+    }
+    sprintf(extra, "\"numb\": %d, \"iou\": %.4f", frac -> numb, score.iou);
+    report(b, "collagescore", "collage", numfuncs, 0, width, median(times, b -> reps), 1, extra);
+    free(params);
+    freefrac(frac);
+}
+
+static void benchimage(struct Bench *b, int numfuncs, int numpoints, int width){
+    /* generatematrix, stddev + dimension and WritePNG on the same fractal */
+    double tmatrix[MAXREPS], tstats[MAXREPS], tpng[MAXREPS], extrema[4];
+    struct Fractal *frac = benchfrac(numfuncs, numpoints, width, ENGINE_SCALAR, 0);
+    generatepoints(frac, extrema);
+    for (int r = -b -> warmup; r < b -> reps; r++){
+        double t = now();
+        generatematrix(frac, frac -> window);
+        double t1 = now();
+        stddev(frac);
+        dimension(frac);
+        double t2 = now();
+        WritePNG(b -> pngfile, frac);
+        double t3 = now();
+        if (r >= 0){
+            tmatrix[r] = t1 - t;
+            tstats[r]  = t2 - t1;
+            tpng[r]    = t3 - t2;
+        }
+    }
+    double pixels = (double)width * width;
+    report(b, "generatematrix", "scalar", numfuncs, numpoints, width, median(tmatrix, b -> reps), numpoints, NULL);
+    report(b, "stddev+dimension", "scalar", numfuncs, numpoints, width, median(tstats, b -> reps), pixels, NULL);
+    report(b, "WritePNG", "scalar", numfuncs, numpoints, width, median(tpng, b -> reps), pixels, NULL);
+    freefrac(frac);
+}
+
+int main(int argc, char *argv[]){
+    int i, nf, np, isa, best = simdisa(), maxpoints = 10000000;
+    int resolutions[4] = {160, 320, 640, 1280};
+    char *outname = NULL;
+    char *tmpdir = "/tmp";
+    struct Bench b;
+    b.out    = stdout;
+    b.warmup = 1;
+    b.reps   = 5;
+    b.first  = 1;
+    for (i = 1; i < argc; i++){
+        if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) outname = argv[++i];
+        else if (strcmp(argv[i], "--reps") == 0 && i + 1 < argc) b.reps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) b.warmup = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--tmpdir") == 0 && i + 1 < argc) tmpdir = argv[++i];
+        else if (strcmp(argv[i], "--quick") == 0){
+            maxpoints = 1000000;
+            b.reps = 3;
+        }
+        else {
+            fprintf(stderr, "Usage: %s [--out FILE] [--reps N] [--warmup N] [--tmpdir DIR] [--quick]\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (b.reps < 1) b.reps = 1;
+    if (b.reps > MAXREPS) b.reps = MAXREPS;
+    if (outname != NULL && (b.out = fopen(outname, "w")) == NULL){
+        fprintf(stderr, "Failed to open file (bench): %s\n", outname);
+        exit(1);
+    }
+    snprintf(b.pngfile, sizeof(b.pngfile), "%s/bench%d.png", tmpdir, (int)getpid());
+
+    fprintf(b.out, "{\n  \"isa\": \"%s\",\n  \"walkers\": %d,\n  \"warmup\": %d,\n  \"reps\": %d,\n  \"results\": [",
+            simdisaname(simdisa()), WALKERS, b.warmup, b.reps);
+    for (nf = 2; nf <= 8; nf++){
+        benchgenome(&b, nf);
+        benchpoints(&b, nf, 100000, ENGINE_SCALAR);
+        //the simd walkers in each instruction set the cpu has
+        for (isa = ISA_SSE2; isa <= best; isa++){
+            setsimdisa(isa);
+            benchpoints(&b, nf, 100000, ENGINE_SIMD);
+        }
+        setsimdisa(best);
+    }
+    for (np = 10000; np <= maxpoints; np *= 10){
+        benchpoints(&b, 4, np, ENGINE_SCALAR);
+        benchpoints(&b, 4, np, ENGINE_SIMD);
+        benchstream(&b, 4, np, WIDTH, ENGINE_SCALAR, PREC_DOUBLE);
+        benchstream(&b, 4, np, WIDTH, ENGINE_SIMD, PREC_DOUBLE);
+        benchstream(&b, 4, np, WIDTH, ENGINE_SIMD, PREC_FLOAT);
+        benchstampfloat(&b, np, WIDTH, 1);
+        benchstampfloat(&b, np, WIDTH, 0);
+    }
+    for (nf = 2; nf <= 8; nf += 2){
+        benchifs(&b, nf, WIDTH);
+        benchcollage(&b, nf, WIDTH);
+    }
+    for (i = 0; i < 4; i++){
+        benchifs(&b, 4, resolutions[i]);
+        benchimage(&b, 4, 1000000, resolutions[i]);
+    }
+    fprintf(b.out, "\n  ]\n}\n");
+    if (b.out != stdout) fclose(b.out);
+    unlink(b.pngfile);
+    return 0;
+}
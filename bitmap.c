@@ -0,0 +1,259 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: bitmap.c
+ *
+ * This file contains the functions used to allocate
+ * and clear the pixel maps in bitmap.h, to shrink them
+ * and to count the boxes they cover at each scale
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitmap.h"
+
+void bmalloc(struct Bitmap *bm, int width, int height, int pixtype, int layout){
+    /* This function allocates a width x height pixel map of the
+     * given pixel type and layout, see bmreshape
+     */
+    bm -> data     = NULL;
+    bm -> capacity = 0;
+    bmreshape(bm, width, height, pixtype, layout);
+}
+
+void bmreshape(struct Bitmap *bm, int width, int height, int pixtype, int layout){
+    /* This function makes an allocated pixel map (or one with NULL
+     * data) a width x height map of the given pixel type and layout.
+     * Bit maps are always stored in rows. Tiled maps are padded up to
+     * whole 8x8 tiles. The memory is only reallocated if it is too small.
+     */
+    size_t bytes;
+    bm -> width   = width;
+    bm -> height  = height;
+    bm -> pixtype = pixtype;
+    bm -> layout  = (pixtype == PIX_BIT) ? LAYOUT_ROWS : layout;
+    if (pixtype == PIX_BIT){
+        bm -> stride = (width + 63)/64;
+        bm -> size   = (size_t)bm -> stride * height * sizeof(uint64_t);
+    }
+    else {
+        if      (pixtype == PIX_U8)  bytes = 1;
+        else if (pixtype == PIX_U16) bytes = 2;
+        else                         bytes = 4;
+        if (bm -> layout == LAYOUT_TILES){
+            bm -> stride = (width + 7)/8;
+            bm -> size   = (size_t)bm -> stride * ((height + 7)/8) * 64 * bytes;
+        }
+        else {
+            bm -> stride = width;
+            bm -> size   = (size_t)width * height * bytes;
+        }
+    }
+    if (bm -> size <= bm -> capacity) return;
+    free(bm -> data);
+    if ((bm -> data = malloc(bm -> size)) == NULL){
+        fprintf(stderr, "Malloc Failed. (bmalloc)\n");
+        exit(1);
+    }
+    bm -> capacity = bm -> size;
+}
+
+void bmclear(struct Bitmap *bm){
+    /* This function makes every pixel empty */
+    memset(bm -> data, 0, bm -> size);
+}
+
+void bmfree(struct Bitmap *bm){
+    /* This function frees the memory of a pixel map */
+    free(bm -> data);
+    bm -> data = NULL;
+    bm -> capacity = 0;
+}
+
+void bmdownsample(struct Bitmap *dst, const struct Bitmap *src, int factor){
+    /* This function sets every pixel of dst from the factor x factor
+     * block of src pixels over it: the number of them that are set
+     * for count maps, whether any is set for bit maps and the largest
+     * value for function maps. src must be factor times the size of dst
+     */
+    int x, y, i, j;
+    bmclear(dst);
+    for (y = 0; y < dst -> height; y++){
+        for (x = 0; x < dst -> width; x++){
+            uint32_t hits = 0, most = 0;
+            for (j = 0; j < factor; j++){
+                for (i = 0; i < factor; i++){
+                    uint32_t v = bmget(src, x*factor + i, y*factor + j);
+                    hits += (v != 0);
+                    if (v > most) most = v;
+                }
+            }
+            if (hits == 0) continue;
+            switch (dst -> pixtype){
+                case PIX_BIT:
+                    ((uint64_t *)dst -> data)[(size_t)y * dst -> stride + (x >> 6)] |= 1ULL << (x & 63);
+                    break;
+                case PIX_U8:
+                    ((uint8_t *)dst -> data)[bmindex(dst, x, y)] = (uint8_t)most;
+                    break;
+                case PIX_U16:
+                    ((uint16_t *)dst -> data)[bmindex(dst, x, y)] = (hits > UINT16_MAX) ? UINT16_MAX : (uint16_t)hits;
+                    break;
+                default:
+                    ((uint32_t *)dst -> data)[bmindex(dst, x, y)] = hits;
+            }
+        }
+    }
+}
+
+static __thread uint64_t *pyramid = NULL;  //levels of bmboxcounts, per thread
+static __thread size_t pyramidwords = 0;
+static __thread uint64_t *shrinkbuf = NULL; //halved levels of bmshrink, per thread
+static __thread size_t shrinkwords = 0;
+
+static inline uint64_t squeeze(uint64_t w){
+    /* This function ORs each pair of neighbouring pixels in a word
+     * and packs the 32 results into the low half of the word
+     */
+    w = (w | (w >> 1)) & 0x5555555555555555ULL;
+    w = (w | (w >> 1)) & 0x3333333333333333ULL;
+    w = (w | (w >> 2)) & 0x0f0f0f0f0f0f0f0fULL;
+    w = (w | (w >> 4)) & 0x00ff00ff00ff00ffULL;
+    w = (w | (w >> 8)) & 0x0000ffff0000ffffULL;
+    w = (w | (w >> 16)) & 0x00000000ffffffffULL;
+    return w;
+}
+
+__attribute__((target_clones("popcnt", "default")))
+static double halvelevel(const uint64_t *src, int rows, int words, uint64_t *dst){
+    /* This function makes the next level of the pyramid: every pixel
+     * of dst is the OR of a 2x2 block of src, which has rows rows of
+     * words words. It returns the number of set pixels in dst
+     */
+    int r, j;
+    int newwords = (words + 1)/2;
+    long count = 0;
+    for (r = 0; r < (rows + 1)/2; r++){
+        const uint64_t *top = src + (size_t)(2*r) * words;
+        const uint64_t *bottom = (2*r + 1 < rows) ? top + words : NULL;
+        uint64_t *out = dst + (size_t)r * newwords;
+        for (j = 0; j < newwords; j++){
+            uint64_t lo = top[2*j];
+            uint64_t hi = (2*j + 1 < words) ? top[2*j + 1] : 0;
+            if (bottom != NULL){
+                lo |= bottom[2*j];
+                if (2*j + 1 < words) hi |= bottom[2*j + 1];
+            }
+            out[j] = squeeze(lo) | (squeeze(hi) << 32);
+            count += __builtin_popcountll(out[j]);
+        }
+    }
+    return (double)count;
+}
+
+__attribute__((target_clones("popcnt", "default")))
+static double countbits(const uint64_t *src, size_t n){
+    /* This function returns the number of set bits in n words */
+    long count = 0;
+    for (size_t i = 0; i < n; i++) count += __builtin_popcountll(src[i]);
+    return (double)count;
+}
+
+void bmthreadfree(void){
+    /* This function frees the scratch maps of bmboxcounts and
+     * bmshrink of the calling thread, eg. before it exits
+     */
+    free(pyramid);
+    free(shrinkbuf);
+    pyramid = NULL;
+    shrinkbuf = NULL;
+    pyramidwords = 0;
+    shrinkwords = 0;
+}
+
+int bmboxcounts(const struct Bitmap *bm, double *counts, int maxlevels){
+    /* This function counts the boxes of 2^k x 2^k pixels that hold
+     * part of the attractor, for k = 0, 1, ... until one box covers
+     * the whole image or maxlevels counts have been made. It builds
+     * a pyramid of bit maps, each level the 2x2 OR of the one below,
+     * a word at a time. Pixel maps that are not bits are first turned
+     * into bits. It returns the number of levels counted.
+     */
+    int x, y, level;
+    int words = (bm -> width + 63)/64;
+    int rows  = bm -> height;
+    size_t base = (size_t)words * rows;
+    size_t need = base + base/2 + 2 * (size_t)(words + rows) + 64;
+    const uint64_t *src;
+    uint64_t *dst;
+    if (maxlevels < 1) return 0;
+    if (pyramidwords < need){
+        free(pyramid);
+        if ((pyramid = (uint64_t *)malloc(need * sizeof(uint64_t))) == NULL){
+            fprintf(stderr, "Malloc failed. (bmboxcounts)\n");
+            exit(1);
+        }
+        pyramidwords = need;
+    }
+    if (bm -> pixtype == PIX_BIT){
+        src = (const uint64_t *)bm -> data;
+    }
+    else {
+        memset(pyramid, 0, base * sizeof(uint64_t));
+        for (y = 0; y < rows; y++){
+            for (x = 0; x < bm -> width; x++){
+                if (bmget(bm, x, y) != 0) pyramid[(size_t)y * words + (x >> 6)] |= 1ULL << (x & 63);
+            }
+        }
+        src = pyramid;
+    }
+    counts[0] = countbits(src, base);
+    //each level fits in the space after the one it is made from
+    dst = pyramid + base;
+    int width = bm -> width;
+    for (level = 1; level < maxlevels && (width > 1 || rows > 1); level++){
+        counts[level] = halvelevel(src, rows, words, dst);
+        src   = dst;
+        dst  += (size_t)((words + 1)/2) * ((rows + 1)/2);
+        words = (words + 1)/2;
+        rows  = (rows + 1)/2;
+        width = (width + 1)/2;
+    }
+    return level;
+}
+
+void bmshrink(struct Bitmap *dst, const struct Bitmap *src, int factor){
+    /* This function makes dst the factor x factor block OR of the bit
+     * map src, as bmdownsample does, but a word at a time by halving
+     * src until it is the size of dst when factor is a power of two.
+     * src must be factor times the size of dst. Other pixel maps and
+     * factors are left to bmdownsample
+     */
+    int words = src -> stride;
+    int rows  = src -> height;
+    const uint64_t *from = (const uint64_t *)src -> data;
+    uint64_t *to;
+    if (src -> pixtype != PIX_BIT || dst -> pixtype != PIX_BIT || factor < 2 || (factor & (factor - 1)) != 0){
+        bmdownsample(dst, src, factor);
+        return;
+    }
+    //every level but the last fits in the space after the one before
+    size_t need = (size_t)words * rows/2 + 2 * (size_t)(words + rows) + 64;
+    if (shrinkwords < need){
+        free(shrinkbuf);
+        if ((shrinkbuf = (uint64_t *)malloc(need * sizeof(uint64_t))) == NULL){
+            fprintf(stderr, "Malloc failed. (bmshrink)\n");
+            exit(1);
+        }
+        shrinkwords = need;
+    }
+    to = shrinkbuf;
+    for (; factor > 2; factor /= 2){
+        halvelevel(from, rows, words, to);
+        from  = to;
+        to   += (size_t)((words + 1)/2) * ((rows + 1)/2);
+        words = (words + 1)/2;
+        rows  = (rows + 1)/2;
+    }
+    halvelevel(from, rows, words, (uint64_t *)dst -> data);
+}
@@ -0,0 +1,112 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: bitmap.h
+ *
+ * The pixel map of a fractal, stored in one contiguous block.
+ * A pixel is either
+ *      PIX_BIT:  1 bit, set if the attractor touches it
+ *      PIX_U8:   the number of the last function to touch it + 1
+ *      PIX_U16,
+ *      PIX_U32:  the number of points that landed on it (or, for a
+ *                supersampled picture, of its subpixels that were hit)
+ * and 0 is always an empty (white) pixel.
+ *
+ * Bit maps are stored as rows of 64 bit words so that whole rows
+ * can be worked on a word at a time. The other types can be stored
+ * in rows or in 8x8 tiles (LAYOUT_TILES), which keeps pixels that
+ * are close in the image close in memory.
+ *
+ * The accessors are inlined since they are called once per point
+ */
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define PIX_BIT 0
+#define PIX_U8  1
+#define PIX_U16 2
+#define PIX_U32 3
+
+#define LAYOUT_ROWS  0
+#define LAYOUT_TILES 1
+
+struct Bitmap{
+    int width, height, pixtype, layout;
+    int stride;   //words per row for bits, pixels per row for rows,
+                  //tiles per row for tiles
+    size_t size;  //size of data in bytes
+    size_t capacity; //bytes allocated, at least size
+    void *data;
+};
+
+static inline size_t bmindex(const struct Bitmap *bm, int x, int y){
+    /* This function returns the index of pixel (x,y) in the data,
+     * in units of the pixel type (bit maps excepted)
+     */
+    if (bm -> layout == LAYOUT_TILES){
+        return ((size_t)((y >> 3) * bm -> stride + (x >> 3)) << 6) | ((y & 7) << 3) | (x & 7);
+    }
+    return (size_t)y * bm -> stride + x;
+}
+
+static inline uint32_t bmget(const struct Bitmap *bm, int x, int y){
+    /* This function returns the value of pixel (x,y) */
+    switch (bm -> pixtype){
+        case PIX_BIT:
+            return (((const uint64_t *)bm -> data)[(size_t)y * bm -> stride + (x >> 6)] >> (x & 63)) & 1;
+        case PIX_U8:
+            return ((const uint8_t *)bm -> data)[bmindex(bm, x, y)];
+        case PIX_U16:
+            return ((const uint16_t *)bm -> data)[bmindex(bm, x, y)];
+        default:
+            return ((const uint32_t *)bm -> data)[bmindex(bm, x, y)];
+    }
+}
+
+static inline int bmstamp(struct Bitmap *bm, int x, int y, int funcnum){
+    /* This function records that a point made by function funcnum
+     * landed on pixel (x,y). It returns 1 if the pixel was empty.
+     * 16 bit counts saturate rather than wrapping around.
+     */
+    switch (bm -> pixtype){
+        case PIX_BIT: {
+            uint64_t *w = (uint64_t *)bm -> data + (size_t)y * bm -> stride + (x >> 6);
+            uint64_t bit = 1ULL << (x & 63);
+            int empty = (*w & bit) == 0;
+            *w |= bit;
+            return empty;
+        }
+        case PIX_U8: {
+            uint8_t *p = (uint8_t *)bm -> data + bmindex(bm, x, y);
+            int empty = *p == 0;
+            *p = (uint8_t)(funcnum + 1);
+            return empty;
+        }
+        case PIX_U16: {
+            uint16_t *p = (uint16_t *)bm -> data + bmindex(bm, x, y);
+            int empty = *p == 0;
+            if (*p != UINT16_MAX) *p += 1;
+            return empty;
+        }
+        default: {
+            uint32_t *p = (uint32_t *)bm -> data + bmindex(bm, x, y);
+            int empty = *p == 0;
+            *p += 1;
+            return empty;
+        }
+    }
+}
+
+void bmalloc(struct Bitmap *bm, int width, int height, int pixtype, int layout);
+void bmreshape(struct Bitmap *bm, int width, int height, int pixtype, int layout);
+void bmclear(struct Bitmap *bm);
+void bmfree(struct Bitmap *bm);
+void bmdownsample(struct Bitmap *dst, const struct Bitmap *src, int factor);
+void bmshrink(struct Bitmap *dst, const struct Bitmap *src, int factor);
+int bmboxcounts(const struct Bitmap *bm, double *counts, int maxlevels);
+void bmthreadfree(void);
+
+#endif
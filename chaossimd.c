@@ -0,0 +1,645 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: chaossimd.c
+ *
+ * This file contains the multi-walker chaos game. Instead of
+ * one orbit, WALKERS independent orbits are advanced together,
+ * each with its own random stream, so that their affine updates
+ * can be done in the lanes of SSE2, AVX2 or AVX-512 registers.
+ * The parameters of each lane's function are gathered from the
+ * packed (structure of arrays) copy of the genome in frac -> params.
+ *
+ * The instruction set is picked at runtime. Every version does
+ * the same operations in the same order as the scalar one, so
+ * the points do not depend on the machine they are made on.
+ *
+ * The walkers can also be run in 32 bit floats (PREC_FLOAT), which
+ * fits all eight in one AVX2 register. They pick the same functions
+ * as the double walkers, so a fractal differs only by rounding, and
+ * only where a point lands near the edge of a pixel (see
+ * checkprecision.c). The walkers are kept in double between calls,
+ * which holds a float value exactly. The points are written out as
+ * doubles, except that the float walkers write floats for
+ * walkerpointsf, which generatestream turns into pixels in float
+ * lanes (floatcoords) without widening.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include "Fractals.h"
+#include "chaossimd.h"
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#define FLOATBATCH 256 //float points widened at a time by walkerpoints
+
+typedef void (*walkfunc)(const double *params, int numfuncs, const int *funcs,
+                         double *wx, double *wy, double *xs, double *ys, int rounds);
+typedef void (*walkfuncf)(const float *params, int numfuncs, const int *funcs,
+                          double *wx, double *wy, float *xs, float *ys, int rounds);
+typedef void (*coordfunc)(const float *xs, const float *ys, int n, const float *scale,
+                          int *pixx, int *pixy, float *extrema);
+
+static void walkscalar(const double *params, int numfuncs, const int *funcs,
+                       double *wx, double *wy, double *xs, double *ys, int rounds){
+    /* This function advances every walker by rounds points, walker k
+     * using function funcs[r*WALKERS + k] in round r, and writes the
+     * new points to xs and ys in the same order
+     */
+    const double *a = params;
+    const double *b = params + numfuncs;
+    const double *c = params + 2*numfuncs;
+    const double *d = params + 3*numfuncs;
+    const double *e = params + 4*numfuncs;
+    const double *f = params + 5*numfuncs;
+    int r, k, i;
+    double x, y;
+    for (r = 0; r < rounds; r++){
+        for (k = 0; k < WALKERS; k++){
+            i = funcs[r*WALKERS + k];
+            x = wx[k];
+            y = wy[k];
+            wx[k] = a[i] * x + b[i] * y + e[i];
+            wy[k] = c[i] * x + d[i] * y + f[i];
+            xs[r*WALKERS + k] = wx[k];
+            ys[r*WALKERS + k] = wy[k];
+        }
+    }
+}
+
+static void walkscalarf(const float *params, int numfuncs, const int *funcs,
+                        double *wx, double *wy, float *xs, float *ys, int rounds){
+    /* float version of walkscalar */
+    const float *a = params;
+    const float *b = params + numfuncs;
+    const float *c = params + 2*numfuncs;
+    const float *d = params + 3*numfuncs;
+    const float *e = params + 4*numfuncs;
+    const float *f = params + 5*numfuncs;
+    float x[WALKERS], y[WALKERS], nx;
+    int r, k, i;
+    for (k = 0; k < WALKERS; k++){
+        x[k] = (float)wx[k];
+        y[k] = (float)wy[k];
+    }
+    for (r = 0; r < rounds; r++){
+        for (k = 0; k < WALKERS; k++){
+            i = funcs[r*WALKERS + k];
+            nx   = a[i] * x[k] + b[i] * y[k] + e[i];
+            y[k] = c[i] * x[k] + d[i] * y[k] + f[i];
+            x[k] = nx;
+            xs[r*WALKERS + k] = x[k];
+            ys[r*WALKERS + k] = y[k];
+        }
+    }
+    for (k = 0; k < WALKERS; k++){
+        wx[k] = x[k];
+        wy[k] = y[k];
+    }
+}
+
+static void coordsscalar(const float *xs, const float *ys, int n, const float *scale,
+                         int *pixx, int *pixy, float *extrema){
+    /* This function turns n float points into pixel coordinates, as
+     * pointtocoord does in double, with scale holding minx, the
+     * pixels per unit in x, miny, the pixels per unit in y and the
+     * height of the window in pixels, and updates their extrema
+     */
+    for (int i = 0; i < n; i++){
+        float x = xs[i], y = ys[i];
+        pixx[i] = (int)((x - scale[0]) * scale[1]);
+        pixy[i] = (int)(scale[4] - (y - scale[2]) * scale[3]);
+        if (x < extrema[0]) extrema[0] = x;
+        if (x > extrema[1]) extrema[1] = x;
+        if (y < extrema[2]) extrema[2] = y;
+        if (y > extrema[3]) extrema[3] = y;
+    }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse2")))
+static void walksse2(const double *params, int numfuncs, const int *funcs,
+                     double *wx, double *wy, double *xs, double *ys, int rounds){
+    /* SSE2 version of walkscalar, two walkers per register. SSE2
+     * has no gather so the parameters are loaded lane by lane
+     */
+    const double *a = params;
+    const double *b = params + numfuncs;
+    const double *c = params + 2*numfuncs;
+    const double *d = params + 3*numfuncs;
+    const double *e = params + 4*numfuncs;
+    const double *f = params + 5*numfuncs;
+    __m128d x[WALKERS/2], y[WALKERS/2];
+    int r, h, i0, i1;
+    for (h = 0; h < WALKERS/2; h++){
+        x[h] = _mm_loadu_pd(wx + 2*h);
+        y[h] = _mm_loadu_pd(wy + 2*h);
+    }
+    for (r = 0; r < rounds; r++){
+        for (h = 0; h < WALKERS/2; h++){
+            i0 = funcs[r*WALKERS + 2*h];
+            i1 = funcs[r*WALKERS + 2*h + 1];
+            __m128d nx = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_set_pd(a[i1], a[i0]), x[h]),
+                                               _mm_mul_pd(_mm_set_pd(b[i1], b[i0]), y[h])),
+                                    _mm_set_pd(e[i1], e[i0]));
+            __m128d ny = _mm_add_pd(_mm_add_pd(_mm_mul_pd(_mm_set_pd(c[i1], c[i0]), x[h]),
+                                               _mm_mul_pd(_mm_set_pd(d[i1], d[i0]), y[h])),
+                                    _mm_set_pd(f[i1], f[i0]));
+            x[h] = nx;
+            y[h] = ny;
+            _mm_storeu_pd(xs + r*WALKERS + 2*h, nx);
+            _mm_storeu_pd(ys + r*WALKERS + 2*h, ny);
+        }
+    }
+    for (h = 0; h < WALKERS/2; h++){
+        _mm_storeu_pd(wx + 2*h, x[h]);
+        _mm_storeu_pd(wy + 2*h, y[h]);
+    }
+}
+
+__attribute__((target("avx2")))
+static void walkavx2(const double *params, int numfuncs, const int *funcs,
+                     double *wx, double *wy, double *xs, double *ys, int rounds){
+    /* AVX2 version of walkscalar, four walkers per register with
+     * the parameters gathered by function number
+     */
+    const double *a = params;
+    const double *b = params + numfuncs;
+    const double *c = params + 2*numfuncs;
+    const double *d = params + 3*numfuncs;
+    const double *e = params + 4*numfuncs;
+    const double *f = params + 5*numfuncs;
+    __m256d x0 = _mm256_loadu_pd(wx), x1 = _mm256_loadu_pd(wx + 4);
+    __m256d y0 = _mm256_loadu_pd(wy), y1 = _mm256_loadu_pd(wy + 4);
+    __m256d nx, ny;
+    __m128i i0, i1;
+    for (int r = 0; r < rounds; r++){
+        i0 = _mm_loadu_si128((const __m128i *)(funcs + r*WALKERS));
+        i1 = _mm_loadu_si128((const __m128i *)(funcs + r*WALKERS + 4));
+        nx = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_i32gather_pd(a, i0, 8), x0),
+                                         _mm256_mul_pd(_mm256_i32gather_pd(b, i0, 8), y0)),
+                           _mm256_i32gather_pd(e, i0, 8));
+        ny = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_i32gather_pd(c, i0, 8), x0),
+                                         _mm256_mul_pd(_mm256_i32gather_pd(d, i0, 8), y0)),
+                           _mm256_i32gather_pd(f, i0, 8));
+        x0 = nx;
+        y0 = ny;
+        nx = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_i32gather_pd(a, i1, 8), x1),
+                                         _mm256_mul_pd(_mm256_i32gather_pd(b, i1, 8), y1)),
+                           _mm256_i32gather_pd(e, i1, 8));
+        ny = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_i32gather_pd(c, i1, 8), x1),
+                                         _mm256_mul_pd(_mm256_i32gather_pd(d, i1, 8), y1)),
+                           _mm256_i32gather_pd(f, i1, 8));
+        x1 = nx;
+        y1 = ny;
+        _mm256_storeu_pd(xs + r*WALKERS,     x0);
+        _mm256_storeu_pd(xs + r*WALKERS + 4, x1);
+        _mm256_storeu_pd(ys + r*WALKERS,     y0);
+        _mm256_storeu_pd(ys + r*WALKERS + 4, y1);
+    }
+    _mm256_storeu_pd(wx, x0);
+    _mm256_storeu_pd(wx + 4, x1);
+    _mm256_storeu_pd(wy, y0);
+    _mm256_storeu_pd(wy + 4, y1);
+}
+
+__attribute__((target("avx512f")))
+static void walkavx512(const double *params, int numfuncs, const int *funcs,
+                       double *wx, double *wy, double *xs, double *ys, int rounds){
+    /* AVX-512 version of walkscalar, all eight walkers in one register */
+    const double *a = params;
+    const double *b = params + numfuncs;
+    const double *c = params + 2*numfuncs;
+    const double *d = params + 3*numfuncs;
+    const double *e = params + 4*numfuncs;
+    const double *f = params + 5*numfuncs;
+    __m512d x = _mm512_loadu_pd(wx);
+    __m512d y = _mm512_loadu_pd(wy);
+    __m512d nx, ny;
+    __m256i i;
+    for (int r = 0; r < rounds; r++){
+        i = _mm256_loadu_si256((const __m256i *)(funcs + r*WALKERS));
+        nx = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(_mm512_i32gather_pd(i, a, 8), x),
+                                         _mm512_mul_pd(_mm512_i32gather_pd(i, b, 8), y)),
+                           _mm512_i32gather_pd(i, e, 8));
+        ny = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(_mm512_i32gather_pd(i, c, 8), x),
+                                         _mm512_mul_pd(_mm512_i32gather_pd(i, d, 8), y)),
+                           _mm512_i32gather_pd(i, f, 8));
+        x = nx;
+        y = ny;
+        _mm512_storeu_pd(xs + r*WALKERS, x);
+        _mm512_storeu_pd(ys + r*WALKERS, y);
+    }
+    _mm512_storeu_pd(wx, x);
+    _mm512_storeu_pd(wy, y);
+}
+
+__attribute__((target("sse2")))
+static void walksse2f(const float *params, int numfuncs, const int *funcs,
+                      double *wx, double *wy, float *xs, float *ys, int rounds){
+    /* SSE2 version of walkscalarf, four walkers per register */
+    const float *a = params;
+    const float *b = params + numfuncs;
+    const float *c = params + 2*numfuncs;
+    const float *d = params + 3*numfuncs;
+    const float *e = params + 4*numfuncs;
+    const float *f = params + 5*numfuncs;
+    __m128 x[2], y[2];
+    int r, h;
+    for (h = 0; h < 2; h++){
+        x[h] = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(wx + 4*h)), _mm_cvtpd_ps(_mm_loadu_pd(wx + 4*h + 2)));
+        y[h] = _mm_movelh_ps(_mm_cvtpd_ps(_mm_loadu_pd(wy + 4*h)), _mm_cvtpd_ps(_mm_loadu_pd(wy + 4*h + 2)));
+    }
+    for (r = 0; r < rounds; r++){
+        for (h = 0; h < 2; h++){
+            const int *i = funcs + r*WALKERS + 4*h;
+            __m128 nx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set_ps(a[i[3]], a[i[2]], a[i[1]], a[i[0]]), x[h]),
+                                              _mm_mul_ps(_mm_set_ps(b[i[3]], b[i[2]], b[i[1]], b[i[0]]), y[h])),
+                                   _mm_set_ps(e[i[3]], e[i[2]], e[i[1]], e[i[0]]));
+            __m128 ny = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set_ps(c[i[3]], c[i[2]], c[i[1]], c[i[0]]), x[h]),
+                                              _mm_mul_ps(_mm_set_ps(d[i[3]], d[i[2]], d[i[1]], d[i[0]]), y[h])),
+                                   _mm_set_ps(f[i[3]], f[i[2]], f[i[1]], f[i[0]]));
+            x[h] = nx;
+            y[h] = ny;
+            _mm_storeu_ps(xs + r*WALKERS + 4*h, nx);
+            _mm_storeu_ps(ys + r*WALKERS + 4*h, ny);
+        }
+    }
+    for (h = 0; h < 2; h++){
+        _mm_storeu_pd(wx + 4*h,     _mm_cvtps_pd(x[h]));
+        _mm_storeu_pd(wx + 4*h + 2, _mm_cvtps_pd(_mm_movehl_ps(x[h], x[h])));
+        _mm_storeu_pd(wy + 4*h,     _mm_cvtps_pd(y[h]));
+        _mm_storeu_pd(wy + 4*h + 2, _mm_cvtps_pd(_mm_movehl_ps(y[h], y[h])));
+    }
+}
+
+__attribute__((target("avx2")))
+static void walkavx2f(const float *params, int numfuncs, const int *funcs,
+                      double *wx, double *wy, float *xs, float *ys, int rounds){
+    /* AVX2 version of walkscalarf, all eight walkers in one register.
+     * It is also used on AVX-512 machines, as sixteen lanes would
+     * need twice the walkers
+     */
+    const float *a = params;
+    const float *b = params + numfuncs;
+    const float *c = params + 2*numfuncs;
+    const float *d = params + 3*numfuncs;
+    const float *e = params + 4*numfuncs;
+    const float *f = params + 5*numfuncs;
+    __m256 x = _mm256_set_m128(_mm256_cvtpd_ps(_mm256_loadu_pd(wx + 4)), _mm256_cvtpd_ps(_mm256_loadu_pd(wx)));
+    __m256 y = _mm256_set_m128(_mm256_cvtpd_ps(_mm256_loadu_pd(wy + 4)), _mm256_cvtpd_ps(_mm256_loadu_pd(wy)));
+    __m256 nx, ny;
+    __m256i i;
+    for (int r = 0; r < rounds; r++){
+        i = _mm256_loadu_si256((const __m256i *)(funcs + r*WALKERS));
+        nx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_i32gather_ps(a, i, 4), x),
+                                         _mm256_mul_ps(_mm256_i32gather_ps(b, i, 4), y)),
+                           _mm256_i32gather_ps(e, i, 4));
+        ny = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_i32gather_ps(c, i, 4), x),
+                                         _mm256_mul_ps(_mm256_i32gather_ps(d, i, 4), y)),
+                           _mm256_i32gather_ps(f, i, 4));
+        x = nx;
+        y = ny;
+        _mm256_storeu_ps(xs + r*WALKERS, x);
+        _mm256_storeu_ps(ys + r*WALKERS, y);
+    }
+    _mm256_storeu_pd(wx,     _mm256_cvtps_pd(_mm256_castps256_ps128(x)));
+    _mm256_storeu_pd(wx + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)));
+    _mm256_storeu_pd(wy,     _mm256_cvtps_pd(_mm256_castps256_ps128(y)));
+    _mm256_storeu_pd(wy + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(y, 1)));
+}
+
+__attribute__((target("sse2")))
+static void coordssse2(const float *xs, const float *ys, int n, const float *scale,
+                       int *pixx, int *pixy, float *extrema){
+    /* SSE2 version of coordsscalar, four points at a time */
+    const __m128 minx = _mm_set1_ps(scale[0]), sx = _mm_set1_ps(scale[1]);
+    const __m128 miny = _mm_set1_ps(scale[2]), sy = _mm_set1_ps(scale[3]), h = _mm_set1_ps(scale[4]);
+    __m128 lox = _mm_set1_ps(extrema[0]), hix = _mm_set1_ps(extrema[1]);
+    __m128 loy = _mm_set1_ps(extrema[2]), hiy = _mm_set1_ps(extrema[3]);
+    float ext[4][4];
+    int i, k;
+    for (i = 0; i + 4 <= n; i += 4){
+        __m128 x = _mm_loadu_ps(xs + i), y = _mm_loadu_ps(ys + i);
+        _mm_storeu_si128((__m128i *)(pixx + i), _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(x, minx), sx)));
+        _mm_storeu_si128((__m128i *)(pixy + i), _mm_cvttps_epi32(_mm_sub_ps(h, _mm_mul_ps(_mm_sub_ps(y, miny), sy))));
+        lox = _mm_min_ps(x, lox);
+        hix = _mm_max_ps(x, hix);
+        loy = _mm_min_ps(y, loy);
+        hiy = _mm_max_ps(y, hiy);
+    }
+    _mm_storeu_ps(ext[0], lox);
+    _mm_storeu_ps(ext[1], hix);
+    _mm_storeu_ps(ext[2], loy);
+    _mm_storeu_ps(ext[3], hiy);
+    for (k = 0; k < 4; k++){
+        if (ext[0][k] < extrema[0]) extrema[0] = ext[0][k];
+        if (ext[1][k] > extrema[1]) extrema[1] = ext[1][k];
+        if (ext[2][k] < extrema[2]) extrema[2] = ext[2][k];
+        if (ext[3][k] > extrema[3]) extrema[3] = ext[3][k];
+    }
+    coordsscalar(xs + i, ys + i, n - i, scale, pixx + i, pixy + i, extrema);
+}
+
+__attribute__((target("avx2")))
+static void coordsavx2(const float *xs, const float *ys, int n, const float *scale,
+                       int *pixx, int *pixy, float *extrema){
+    /* AVX2 version of coordsscalar, eight points at a time */
+    const __m256 minx = _mm256_set1_ps(scale[0]), sx = _mm256_set1_ps(scale[1]);
+    const __m256 miny = _mm256_set1_ps(scale[2]), sy = _mm256_set1_ps(scale[3]), h = _mm256_set1_ps(scale[4]);
+    __m256 lox = _mm256_set1_ps(extrema[0]), hix = _mm256_set1_ps(extrema[1]);
+    __m256 loy = _mm256_set1_ps(extrema[2]), hiy = _mm256_set1_ps(extrema[3]);
+    float ext[4][8];
+    int i, k;
+    for (i = 0; i + 8 <= n; i += 8){
+        __m256 x = _mm256_loadu_ps(xs + i), y = _mm256_loadu_ps(ys + i);
+        _mm256_storeu_si256((__m256i *)(pixx + i), _mm256_cvttps_epi32(_mm256_mul_ps(_mm256_sub_ps(x, minx), sx)));
+        _mm256_storeu_si256((__m256i *)(pixy + i), _mm256_cvttps_epi32(_mm256_sub_ps(h, _mm256_mul_ps(_mm256_sub_ps(y, miny), sy))));
+        lox = _mm256_min_ps(x, lox);
+        hix = _mm256_max_ps(x, hix);
+        loy = _mm256_min_ps(y, loy);
+        hiy = _mm256_max_ps(y, hiy);
+    }
+    _mm256_storeu_ps(ext[0], lox);
+    _mm256_storeu_ps(ext[1], hix);
+    _mm256_storeu_ps(ext[2], loy);
+    _mm256_storeu_ps(ext[3], hiy);
+    for (k = 0; k < 8; k++){
+        if (ext[0][k] < extrema[0]) extrema[0] = ext[0][k];
+        if (ext[1][k] > extrema[1]) extrema[1] = ext[1][k];
+        if (ext[2][k] < extrema[2]) extrema[2] = ext[2][k];
+        if (ext[3][k] > extrema[3]) extrema[3] = ext[3][k];
+    }
+    coordsscalar(xs + i, ys + i, n - i, scale, pixx + i, pixy + i, extrema);
+}
+
+#endif
+
+static int isa = -1; //the instruction set in use, -1 until it is picked
+
+int simdisa(void){
+    /* This function returns the instruction set used by the
+     * walkers, picking the best one the cpu supports on first use
+     */
+    if (isa < 0){
+        int best = ISA_SCALAR;
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        best = ISA_SSE2;
+        if (__builtin_cpu_supports("avx2")) best = ISA_AVX2;
+        if (__builtin_cpu_supports("avx512f")) best = ISA_AVX512;
+#endif
+        isa = best;
+    }
+    return isa;
+}
+
+void setsimdisa(int newisa){
+    /* This function forces the walkers to use a given instruction
+     * set, eg. to compare them. It is capped at the best one the
+     * cpu supports, and should be called before any threads start
+     */
+    isa = -1;
+    int best = simdisa();
+    isa = (newisa < best) ? newisa : best;
+    if (isa < ISA_SCALAR) isa = ISA_SCALAR;
+}
+
+const char * simdisaname(int i){
+    /* This function returns the name of an instruction set */
+    if (i == ISA_AVX512) return "avx512";
+    if (i == ISA_AVX2)   return "avx2";
+    if (i == ISA_SSE2)   return "sse2";
+    return "scalar";
+}
+
+static walkfunc pickwalk(void){
+    /* This function returns the walker kernel for the instruction set in use */
+    switch (simdisa()){
+#if defined(__x86_64__)
+        case ISA_AVX512: return walkavx512;
+        case ISA_AVX2:   return walkavx2;
+        case ISA_SSE2:   return walksse2;
+#endif
+        default:         return walkscalar;
+    }
+}
+
+static walkfuncf pickwalkf(void){
+    /* This function returns the float walker kernel for the instruction set in use */
+    switch (simdisa()){
+#if defined(__x86_64__)
+        case ISA_AVX512:
+        case ISA_AVX2:   return walkavx2f;
+        case ISA_SSE2:   return walksse2f;
+#endif
+        default:         return walkscalarf;
+    }
+}
+
+static coordfunc pickcoords(void){
+    /* This function returns the pixel coordinate kernel for the instruction set in use */
+    switch (simdisa()){
+#if defined(__x86_64__)
+        case ISA_AVX512:
+        case ISA_AVX2:   return coordsavx2;
+        case ISA_SSE2:   return coordssse2;
+#endif
+        default:         return coordsscalar;
+    }
+}
+
+static void walk(struct Fractal *frac, const int *funcs, double *xs, double *ys, int rounds){
+    /* This function advances the walkers by rounds points in double
+     * (see walkerpointsf for float)
+     */
+    pickwalk()(frac -> params, frac -> numfuncs, funcs, frac -> walkx, frac -> walky, xs, ys, rounds);
+}
+
+void startwalkers(struct Fractal *frac){
+    /* This function gives every walker its own random stream, split
+     * off the fractal's stream, and starts it at a random point.
+     * As in startorbit, the first 100 points of every walker are
+     * thrown away.
+     */
+    for (int k = 0; k < WALKERS; k++){
+        struct Rand *rng = &frac -> walkrng[k];
+        seedrand(rng, nextrand(&frac -> rng));
+        double x = randdouble(rng);
+        double y = randdouble(rng);
+        for (int i = 0; i < 100; i++){
+            func(&x, &y, frac -> genome, randint(rng, frac -> numfuncs));
+        }
+        frac -> walkx[k] = x;
+        frac -> walky[k] = y;
+    }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+static inline __m256i nextrandavx2(__m256i *s0, __m256i *s1, __m256i *s2, __m256i *s3){
+    /* This function is nextrand on four streams, one per 64 bit lane.
+     * AVX2 has no 64 bit multiply, so x*5 and x*9 are shifts and adds
+     */
+    __m256i m = _mm256_add_epi64(_mm256_slli_epi64(*s1, 2), *s1);
+    __m256i r = _mm256_or_si256(_mm256_slli_epi64(m, 7), _mm256_srli_epi64(m, 57));
+    __m256i t = _mm256_slli_epi64(*s1, 17);
+    r = _mm256_add_epi64(_mm256_slli_epi64(r, 3), r);
+    *s2 = _mm256_xor_si256(*s2, *s0);
+    *s3 = _mm256_xor_si256(*s3, *s1);
+    *s1 = _mm256_xor_si256(*s1, *s2);
+    *s0 = _mm256_xor_si256(*s0, *s3);
+    *s2 = _mm256_xor_si256(*s2, t);
+    *s3 = _mm256_or_si256(_mm256_slli_epi64(*s3, 45), _mm256_srli_epi64(*s3, 19));
+    return r;
+}
+
+__attribute__((target("avx2")))
+static void pickfuncsavx2(struct Fractal *frac, int *funcs, int rounds){
+    /* AVX2 version of pickfuncs. The eight streams are advanced in two
+     * registers of four, and each round's eight 32 bit random numbers
+     * are compared with every threshold at once, so the choices are
+     * the ones selectfuncs makes walker by walker. The compare is a
+     * signed one, so both sides have their top bit flipped
+     */
+    const __m256i flip = _mm256_set1_epi32((int)0x80000000);
+    const __m256i halves = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    struct Rand *rng = frac -> walkrng;
+    const uint32_t *thresh = frac -> thresh;
+    int n = frac -> numfuncs - 1;
+    __m256i s[2][4], bits[2], r, count;
+    for (int h = 0; h < 2; h++){
+        for (int w = 0; w < 4; w++){
+            s[h][w] = _mm256_set_epi64x((long long)rng[4*h+3].s[w], (long long)rng[4*h+2].s[w],
+                                        (long long)rng[4*h+1].s[w], (long long)rng[4*h].s[w]);
+        }
+    }
+    bits[0] = bits[1] = _mm256_setzero_si256();
+    for (int i = 0; i < rounds; i++){
+        if ((i & 1) == 0){
+            //the low halves of the eight numbers go to the lower 128 bits
+            for (int h = 0; h < 2; h++){
+                bits[h] = _mm256_permutevar8x32_epi32(nextrandavx2(&s[h][0], &s[h][1], &s[h][2], &s[h][3]), halves);
+            }
+            r = _mm256_permute2x128_si256(bits[0], bits[1], 0x20);
+        }
+        else r = _mm256_permute2x128_si256(bits[0], bits[1], 0x31);
+        r = _mm256_xor_si256(r, flip);
+        count = _mm256_set1_epi32(n);
+        for (int j = 0; j < n; j++){
+            count = _mm256_add_epi32(count, _mm256_cmpgt_epi32(_mm256_set1_epi32((int)(thresh[j] ^ 0x80000000u)), r));
+        }
+        _mm256_storeu_si256((__m256i *)(funcs + i*WALKERS), count);
+    }
+    for (int h = 0; h < 2; h++){
+        for (int w = 0; w < 4; w++){
+            uint64_t lanes[4];
+            _mm256_storeu_si256((__m256i *)lanes, s[h][w]);
+            for (int k = 0; k < 4; k++) rng[4*h+k].s[w] = lanes[k];
+        }
+    }
+}
+#endif
+
+static void pickfuncs(struct Fractal *frac, int *funcs, int rounds){
+    /* This function picks the function each walker uses in each of
+     * the next rounds, from the walker's own random stream
+     */
+#if defined(__x86_64__)
+    if (simdisa() >= ISA_AVX2){
+        pickfuncsavx2(frac, funcs, rounds);
+        return;
+    }
+#endif
+    for (int k = 0; k < WALKERS; k++){
+        selectfuncs(frac, &frac -> walkrng[k], funcs + k, rounds, WALKERS);
+    }
+}
+
+void walkerpointsf(struct Fractal *frac, float *xs, float *ys, int *colours, int n){
+    /* This function generates the next n points of the walkers of a
+     * PREC_FLOAT fractal as floats, as walkerpoints does. They can be
+     * drawn with floatcoords and stamppixels without being widened
+     */
+    int rounds = n / WALKERS;
+    int rest = n - rounds * WALKERS;
+    walkfuncf walkf = pickwalkf();
+    pickfuncs(frac, colours, rounds);
+    walkf(frac -> fparams, frac -> numfuncs, colours, frac -> walkx, frac -> walky, xs, ys, rounds);
+    if (rest > 0){
+        float tx[WALKERS], ty[WALKERS];
+        int tc[WALKERS];
+        pickfuncs(frac, tc, 1);
+        walkf(frac -> fparams, frac -> numfuncs, tc, frac -> walkx, frac -> walky, tx, ty, 1);
+        int done = rounds * WALKERS;
+        memcpy(xs + done, tx, rest * sizeof(float));
+        memcpy(ys + done, ty, rest * sizeof(float));
+        memcpy(colours + done, tc, rest * sizeof(int));
+    }
+}
+
+void walkerpoints(struct Fractal *frac, double *xs, double *ys, int *colours, int n){
+    /* This function generates the next n points of the walkers.
+     * Point i comes from walker i % WALKERS. If n is not a multiple
+     * of WALKERS the points of the last, partial round are dropped
+     * for the walkers past n.
+     */
+    int rounds = n / WALKERS;
+    int rest = n - rounds * WALKERS;
+    if (frac -> precision == PREC_FLOAT){
+        //FLOATBATCH is a multiple of WALKERS, so only the last batch has a partial round
+        float fx[FLOATBATCH], fy[FLOATBATCH];
+        int i, j, m;
+        for (i = 0; i < n; i += m){
+            m = (n - i < FLOATBATCH) ? n - i : FLOATBATCH;
+            walkerpointsf(frac, fx, fy, colours + i, m);
+            for (j = 0; j < m; j++){
+                xs[i+j] = fx[j];
+                ys[i+j] = fy[j];
+            }
+        }
+        return;
+    }
+    pickfuncs(frac, colours, rounds);
+    walk(frac, colours, xs, ys, rounds);
+    if (rest > 0){
+        double tx[WALKERS], ty[WALKERS];
+        int tc[WALKERS];
+        pickfuncs(frac, tc, 1);
+        walk(frac, tc, tx, ty, 1);
+        int done = rounds * WALKERS;
+        memcpy(xs + done, tx, rest * sizeof(double));
+        memcpy(ys + done, ty, rest * sizeof(double));
+        memcpy(colours + done, tc, rest * sizeof(int));
+    }
+}
+
+void floatcoords(const float *xs, const float *ys, int n, const double *window, int width, int height,
+                 int *pixx, int *pixy, double *extrema, int first){
+    /* This function turns n float points into the pixel coordinates
+     * of a width x height picture of window, in float lanes, and
+     * updates their extrema as updateextrema does. Rounding can put
+     * a point near the edge of a pixel in the next one over from the
+     * one pointtocoord gives
+     */
+    float scale[5], ext[4];
+    if (n <= 0) return;
+    scale[0] = (float)window[0];
+    scale[1] = (float)(2*(width/2) / (window[1] - window[0]));
+    scale[2] = (float)window[2];
+    scale[3] = (float)(2*(height/2) / (window[3] - window[2]));
+    scale[4] = (float)(2*(height/2));
+    if (first != 0){
+        ext[0] = ext[1] = xs[0];
+        ext[2] = ext[3] = ys[0];
+    }
+    else {
+        for (int k = 0; k < 4; k++) ext[k] = (float)extrema[k];
+    }
+    pickcoords()(xs, ys, n, scale, pixx, pixy, ext);
+    for (int k = 0; k < 4; k++) extrema[k] = ext[k];
+}
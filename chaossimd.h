@@ -0,0 +1,19 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: chaossimd.h
+ */
+#define ISA_SCALAR 0
+#define ISA_SSE2   1
+#define ISA_AVX2   2
+#define ISA_AVX512 3
+
+struct Fractal;
+int simdisa(void);
+void setsimdisa(int newisa);
+const char * simdisaname(int i);
+void startwalkers(struct Fractal *frac);
+void walkerpoints(struct Fractal *frac, double *xs, double *ys, int *colours, int n);
+void walkerpointsf(struct Fractal *frac, float *xs, float *ys, int *colours, int n);
+void floatcoords(const float *xs, const float *ys, int n, const double *window, int width, int height,
+                 int *pixx, int *pixy, double *extrema, int first);
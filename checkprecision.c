@@ -0,0 +1,303 @@
+/*Created by:    Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: checkprecision.c
+ *
+ * This is the main file that, when run, checks how much running the
+ * chaos game in float (generatedata --precision float), or
+ * drawing the fractals with the deterministic renderer
+ * (generatedata --deterministic), changes the fractals of a dataset
+ *
+ * Every fractal number of --count (1000) is drawn from the seed
+ * generatedata --seed S (1) gives it, twice: by the simd walkers in
+ * double and in float. Both use the same
+ * random streams, so they pick the same genome and the same functions
+ * and their points differ only by rounding. The pixels set in one
+ * picture and not the other are counted, and the pixel disagreement
+ * rate is their number over the number set in either.
+ *
+ * With --deterministic the second picture is drawn by generateifs
+ * instead, which draws the pixels a chaos game of --points points
+ * is more likely than not to hit, so the two should differ about as
+ * much as two chaos games with different seeds do, on both sides.
+ * A long run (eg. --points 4000000) shows whether it draws more or
+ * less than the attractor.
+ *
+ * With the cutoff (unless --no-cutoff) a genome whose pilot orbit
+ * leaves the window is redrawn, and rounding can change that call,
+ * so a seed can give a different genome in the two precisions. Such
+ * fractals are counted but not compared pixel by pixel.
+ *
+ * The run is set like generatedata with --points (100000), --funcs
+ * (4), --resolution, --window and --autofit, and
+ * the fractals are shared out to --threads workers (all cores by
+ * default). --out FILE gets a line per fractal:
+ *
+ *      fracnum  same genome  pixels differing  pixels in either
+ *      numb in double  numb in the precision  pixels only in double
+ *
+ * and the totals are written to stdout. With --max-rate R the exit
+ * status is 2 if the pixel disagreement rate is above R, so a run
+ * can check a precision is safe before a dataset is made with it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "Fractals.h"
+#include "fracfuncs.h"
+
+struct Options{
+    int numthreads, count;
+    int deterministic;     //compare against generateifs, not a precision
+    uint64_t masterseed;
+    double maxrate;        //the highest disagreement rate allowed, or -1
+    char *outfile;
+    struct FracConfig cfg; //of the fractals in double
+    struct FracConfig low; //and in the precision being checked
+};
+
+struct Check{
+    int samegenome;
+    long differing, either;    //pixels set in one picture, and in either
+    long onlydouble;           //pixels set only in the double picture
+    int numbdouble, numblow;
+    double tdouble, tlow;      //seconds taken to draw each picture
+};
+
+struct Pool{
+    struct Options *opt;
+    struct Check *checks;
+    atomic_int next;       //next fractal to be claimed by a worker
+};
+
+static double now(void){
+    /* This function returns a monotonic time in seconds */
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void comparefracs(struct Fractal *a, struct Fractal *b, struct Check *c){
+    /* This function compares the genomes and pictures of a fractal
+     * drawn in two precisions
+     */
+    int n = a -> numfuncs;
+    const uint64_t *p = (const uint64_t *)a -> bm.data;
+    const uint64_t *q = (const uint64_t *)b -> bm.data;
+    size_t i, words = a -> bm.size / sizeof(uint64_t);
+    c -> samegenome = memcmp(a -> genome[0], b -> genome[0], 4*n*sizeof(double)) == 0
+                   && memcmp(a -> genome[1], b -> genome[1], 2*n*sizeof(double)) == 0;
+    c -> numbdouble = a -> numb;
+    c -> numblow    = b -> numb;
+    c -> differing  = 0;
+    c -> either     = 0;
+    c -> onlydouble = 0;
+    if (!c -> samegenome) return;
+    for (i = 0; i < words; i++){
+        c -> differing  += __builtin_popcountll(p[i] ^ q[i]);
+        c -> either     += __builtin_popcountll(p[i] | q[i]);
+        c -> onlydouble += __builtin_popcountll(p[i] & ~q[i]);
+    }
+}
+
+static void *worker(void *arg){
+    /* This function is run by each worker thread. It claims fractal
+     * numbers until there are none left and draws and compares each
+     * one in both precisions, in two fractals it reuses
+     */
+    struct Pool *pool = (struct Pool *)arg;
+    struct Options *opt = pool -> opt;
+    struct Fractal *a = NULL, *b = NULL;
+    int i;
+    while ((i = atomic_fetch_add(&pool -> next, 1)) < opt -> count){
+        uint64_t seed = fracseed(opt -> masterseed, i);
+        struct Check *c = &pool -> checks[i];
+        double t = now();
+        if (a == NULL) a = makefrac(&opt -> cfg, seed);
+        else remakefrac(a, &opt -> cfg, seed);
+        c -> tdouble = now() - t;
+        t = now();
+        if (b == NULL) b = makefrac(&opt -> low, seed);
+        else remakefrac(b, &opt -> low, seed);
+        c -> tlow = now() - t;
+        comparefracs(a, b, c);
+    }
+    if (a != NULL) freefrac(a);
+    if (b != NULL) freefrac(b);
+    return NULL;
+}
+
+static void usage(void){
+    fprintf(stderr, "Usage: checkprecision [--precision float | --deterministic] [--count N] [--seed MASTERSEED] [--points N]\n"
+                    "       [--funcs N] [--resolution WIDTH HEIGHT] [--window MINX,MAXX,MINY,MAXY] [--autofit]\n"
+                    "       [--no-cutoff] [--threads N] [--out FILE] [--max-rate R]\n");
+    exit(1);
+}
+
+static void parseargs(int argc, char **argv, struct Options *opt){
+    /* This function sets the options in argv, which holds only options */
+    int i;
+    for (i = 0; i < argc; i++){
+        if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc){
+            i++;
+            if (strcmp(argv[i], "float") != 0){
+                fprintf(stderr, "The precision checked is float\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--deterministic") == 0){
+            opt -> deterministic = 1;
+        }
+        else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc){
+            opt -> count = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc){
+            opt -> masterseed = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--points") == 0 && i + 1 < argc){
+            opt -> cfg.numpoints = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--funcs") == 0 && i + 1 < argc){
+            opt -> cfg.numfuncs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--resolution") == 0 && i + 2 < argc){
+            opt -> cfg.width  = atoi(argv[++i]);
+            opt -> cfg.height = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc){
+            double *w = opt -> cfg.window;
+            if (sscanf(argv[++i], "%lf,%lf,%lf,%lf", &w[0], &w[1], &w[2], &w[3]) != 4 || w[0] >= w[1] || w[2] >= w[3]){
+                fprintf(stderr, "The window should be MINX,MAXX,MINY,MAXY, eg. -8,8,-8,8\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--autofit") == 0){
+            opt -> cfg.autofit = 1;
+        }
+        else if (strcmp(argv[i], "--no-cutoff") == 0){
+            opt -> cfg.cutoff = 0;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc){
+            opt -> numthreads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc){
+            opt -> outfile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--max-rate") == 0 && i + 1 < argc){
+            opt -> maxrate = atof(argv[++i]);
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            usage();
+        }
+    }
+}
+
+int main(int argc, char *argv[]){
+    struct Options opt;
+    struct Pool pool;
+    pthread_t *threads;
+    double start, seconds, rate, maxfracrate = 0, sumrate = 0, tdouble = 0, tlow = 0;
+    long differing = 0, either = 0, onlydouble = 0;
+    const char *name;
+    int i, compared = 0, changed = 0, newgenomes = 0;
+    FILE *out = NULL;
+
+    memset(&opt, 0, sizeof(opt));
+    defaultconfig(&opt.cfg, 4, 100000);
+    opt.cfg.stream = 1;
+    opt.cfg.cutoff = 1;
+    opt.count      = 1000;
+    opt.masterseed = 1;
+    opt.maxrate    = -1;
+    opt.numthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    parseargs(argc - 1, argv + 1, &opt);
+    if (opt.numthreads < 1) opt.numthreads = 1;
+    if (opt.count < 1 || opt.cfg.numpoints < 1 || opt.cfg.numfuncs < 1){
+        fprintf(stderr, "The count and the number of points and of functions must be positive\n");
+        exit(1);
+    }
+    if (opt.cfg.width < 8 || opt.cfg.height < 8){
+        fprintf(stderr, "The resolution must be at least 8 x 8\n");
+        exit(1);
+    }
+    opt.cfg.engine    = ENGINE_SIMD;
+    opt.low           = opt.cfg;
+    opt.low.precision = PREC_FLOAT;
+    if (opt.deterministic){
+        opt.low.engine    = ENGINE_IFS;
+        opt.low.precision = PREC_DOUBLE;
+    }
+
+    pool.opt = &opt;
+    atomic_init(&pool.next, 0);
+    if ((pool.checks = (struct Check *)calloc(opt.count, sizeof(struct Check))) == NULL ||
+        (threads = (pthread_t *)malloc(opt.numthreads * sizeof(pthread_t))) == NULL){
+        fprintf(stderr, "Malloc failed. (checkprecision)\n");
+        exit(1);
+    }
+    start = now();
+    for (i = 0; i < opt.numthreads; i++){
+        if (pthread_create(&threads[i], NULL, worker, &pool) != 0){
+            fprintf(stderr, "Failed to create worker thread %d\n", i);
+            exit(1);
+        }
+    }
+    for (i = 0; i < opt.numthreads; i++){
+        pthread_join(threads[i], NULL);
+    }
+    seconds = now() - start;
+
+    if (opt.outfile != NULL && (out = fopen(opt.outfile, "w")) == NULL){
+        fprintf(stderr, "Failed to open file %s\n", opt.outfile);
+        exit(1);
+    }
+    for (i = 0; i < opt.count; i++){
+        struct Check *c = &pool.checks[i];
+        tdouble += c -> tdouble;
+        tlow    += c -> tlow;
+        if (out != NULL){
+            fprintf(out, "%d\t%d\t%ld\t%ld\t%d\t%d\t%ld\n", i, c -> samegenome, c -> differing, c -> either,
+                    c -> numbdouble, c -> numblow, c -> onlydouble);
+        }
+        if (!c -> samegenome){
+            newgenomes++;
+            continue;
+        }
+        compared++;
+        differing += c -> differing;
+        either    += c -> either;
+        onlydouble += c -> onlydouble;
+        if (c -> differing > 0) changed++;
+        rate = (c -> either > 0) ? (double)c -> differing / c -> either : 0;
+        sumrate += rate;
+        if (rate > maxfracrate) maxfracrate = rate;
+    }
+    if (out != NULL) fclose(out);
+    rate = (either > 0) ? (double)differing / either : 0;
+
+    name = opt.deterministic ? "deterministic" : "float";
+    fprintf(stdout, "Checked %d fractals in %s against double in %.2lf s\n", opt.count, name, seconds);
+    fprintf(stdout, "Different genomes:          %d\n", newgenomes);
+    fprintf(stdout, "Fractals with a difference: %d of %d\n", changed, compared);
+    fprintf(stdout, "Pixel disagreement rate:    %.3e (%ld of %ld pixels)\n", rate, differing, either);
+    fprintf(stdout, "Pixels only in double:      %ld\n", onlydouble);
+    fprintf(stdout, "Pixels only in the other:   %ld\n", differing - onlydouble);
+    if (compared > 0){
+        fprintf(stdout, "Mean and max per fractal:   %.3e  %.3e\n", sumrate/compared, maxfracrate);
+    }
+    fprintf(stdout, "Drawing time, double:       %.3lf s\n", tdouble);
+    fprintf(stdout, "Drawing time, %-13s %.3lf s (%.2lfx)\n", opt.deterministic ? "deterministic:" : "float:",
+            tlow, (tlow > 0) ? tdouble/tlow : 0.0);
+    free(pool.checks);
+    free(threads);
+    if (opt.maxrate >= 0 && rate > opt.maxrate){
+        fprintf(stdout, "The disagreement rate is above --max-rate %g\n", opt.maxrate);
+        exit(2);
+    }
+    exit(0);
+}
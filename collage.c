@@ -0,0 +1,130 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: collage.c
+ *
+ * This file contains the collage distance of collage.h. The collage
+ * is drawn with ifsimage, which maps every run of set bits of the
+ * target through every function, and is scored with scorebitmaps.
+ * The border of the target and of the collage is left out (see
+ * clearborder), as stamppoints piles the points that leave the
+ * window onto it. A batch of genomes is shared out to threads, each drawing into
+ * its own collage bit map.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "bitmap.h"
+#include "ifsrender.h"
+#include "collage.h"
+
+static __thread struct Bitmap collagebm; //the collage of the calling thread
+static __thread struct Bitmap innerbm;   //and the target without its border
+
+struct CollageJob{
+    const double *params;
+    int count, numfuncs;
+    const double *window;
+    const struct Bitmap *target;
+    struct Score *scores;
+    atomic_int next;      //next genome to be claimed by a thread
+};
+
+static void clearborder(struct Bitmap *bm){
+    /* This function clears the rows and columns of a bit map that
+     * stamppoints clamps the points outside the window onto (1 and
+     * width-1, 1 and height-1), and row and column 0, which it never
+     * draws on, so they are not scored
+     */
+    uint64_t *data = (uint64_t *)bm -> data;
+    uint64_t mask = ~(3ULL | (1ULL << ((bm -> width - 1) & 63)));
+    int last = (bm -> width - 1) >> 6;
+    int y;
+    memset(data, 0, 2 * bm -> stride * sizeof(uint64_t));
+    memset(data + (size_t)(bm -> height - 1) * bm -> stride, 0, bm -> stride * sizeof(uint64_t));
+    for (y = 2; y < bm -> height - 1; y++){
+        uint64_t *row = data + (size_t)y * bm -> stride;
+        if (last == 0){
+            row[0] &= mask;
+        }
+        else {
+            row[0]    &= ~3ULL;
+            row[last] &= ~(1ULL << ((bm -> width - 1) & 63));
+        }
+    }
+}
+
+void collagescore(const double *params, int numfuncs, const double *window,
+                  const struct Bitmap *target, struct Score *score){
+    /* This function scores the collage of a genome against target,
+     * both without their border
+     */
+    bmreshape(&innerbm, target -> width, target -> height, PIX_BIT, LAYOUT_ROWS);
+    memcpy(innerbm.data, target -> data, target -> size);
+    clearborder(&innerbm);
+    bmreshape(&collagebm, target -> width, target -> height, PIX_BIT, LAYOUT_ROWS);
+    ifsimage(params, numfuncs, window, &innerbm, &collagebm);
+    clearborder(&collagebm);
+    scorebitmaps(&collagebm, &innerbm, score);
+}
+
+void collagethreadfree(void){
+    /* This function frees the bit maps and scoring scratch of the
+     * calling thread
+     */
+    bmfree(&collagebm);
+    bmfree(&innerbm);
+    scorethreadfree();
+}
+
+static void *collageworker(void *arg){
+    /* This function scores genomes of a batch until none are left */
+    struct CollageJob *job = (struct CollageJob *)arg;
+    int i;
+    while ((i = atomic_fetch_add_explicit(&job -> next, 1, memory_order_relaxed)) < job -> count){
+        collagescore(job -> params + (size_t)6 * job -> numfuncs * i, job -> numfuncs, job -> window,
+                     job -> target, &job -> scores[i]);
+    }
+    return NULL;
+}
+
+static void *collagehelper(void *arg){
+    /* This function is run by the threads collagebatch starts, which
+     * free their scratch before they exit
+     */
+    collageworker(arg);
+    collagethreadfree();
+    return NULL;
+}
+
+void collagebatch(const double *params, int count, int numfuncs, const double *window,
+                  const struct Bitmap *target, struct Score *scores, int threads){
+    /* This function scores the collages of count genomes, one after
+     * the other in params, on up to threads threads (the caller's
+     * included) */
+    struct CollageJob job;
+    pthread_t *helpers = NULL;
+    int t, started = 0;
+    job.params   = params;
+    job.count    = count;
+    job.numfuncs = numfuncs;
+    job.window   = window;
+    job.target   = target;
+    job.scores   = scores;
+    atomic_init(&job.next, 0);
+    if (threads > count) threads = count;
+    if (threads > 1 && (helpers = (pthread_t *)malloc((threads - 1) * sizeof(pthread_t))) == NULL){
+        fprintf(stderr, "Malloc failed. (collagebatch)\n");
+        exit(1);
+    }
+    for (t = 0; t < threads - 1; t++){
+        if (pthread_create(&helpers[t], NULL, collagehelper, &job) != 0) break;
+        started++;
+    }
+    collageworker(&job);
+    for (t = 0; t < started; t++) pthread_join(helpers[t], NULL);
+    free(helpers);
+}
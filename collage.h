@@ -0,0 +1,36 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: collage.h
+ *
+ * The collage distance of a genome to a target picture T. By the
+ * collage theorem the attractor A of an IFS W with contraction s
+ * satisfies d(T, A) <= d(T, W(T))/(1 - s), so a genome can be
+ * scored by how well W(T) = f_1(T) u ... u f_n(T) matches T, which
+ * takes one pass over the runs of T and no chaos game.
+ *
+ * The score is that of W(T) against T (see fracscore.h): recall is
+ * how much of T the collage covers, precision how much of the
+ * collage lies on T. Genomes are the 6 x numfuncs parameters of
+ * fracdata.dat, and T is a PIX_BIT bit map drawn in window. The
+ * rows and columns on the edge of T, where stamppoints puts the
+ * points that leave the window, are left out of T and the collage.
+ *
+ * The distance is only meaningful on deterministic (ENGINE_IFS) or
+ * dense targets. A chaos game picture misses pixels of the
+ * attractor, and W(T) fills them in, so even the true genome scores
+ * an iou of about 0.8 on 1e5 point pictures, against 0.98 on
+ * deterministic ones.
+ */
+#ifndef COLLAGE_H
+#define COLLAGE_H
+
+#include "fracscore.h"
+
+void collagescore(const double *params, int numfuncs, const double *window,
+                  const struct Bitmap *target, struct Score *score);
+void collagebatch(const double *params, int count, int numfuncs, const double *window,
+                  const struct Bitmap *target, struct Score *scores, int threads);
+void collagethreadfree(void);
+
+#endif
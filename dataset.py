@@ -3,6 +3,7 @@
 # Last Updated: June 2020
 
 import os
+import ctypes
 import numpy as np
 import torch
 import torch.utils.data as data_utils
@@ -27,8 +28,16 @@ class FractalDataset(data_utils.Dataset):
     #       - y coordinate of centroid
     #       - standard deviation in the x direction
     #       - standard deviation in the y direction
-    #       - fractal dimension estime
+    #       - box counting dimension estimate
     #       - IFS parameters
+    #       - the seed the fractal was generated from (see
+    #         generatedata --render)
+    #       - the viewing window (minx, maxx, miny, maxy) the fractal
+    #         was drawn in
+    #       - covariance of the x and y pixel coordinates
+    #       - orientation of the fractal's major axis in radians
+    #       - correlation dimension of the orbit (-1 unless generated
+    #         with generatedata --corrdim)
     #
     # INITIALIZATIONS:
     #     filename:  the name of the datafile
@@ -38,8 +47,8 @@ class FractalDataset(data_utils.Dataset):
     #                it is loaded
     
     def __init__(self, filename, root_dir, invert = 0, transform=None):
-        fracdata = np.loadtxt(filename)
-        numfuncs = int((len(fracdata[0,:])-9)/7)
+        fracdata = load_fracdata(filename)
+        numfuncs = int(fracdata[0,1])
         self.outputs = fracdata[:, 9:9+6*numfuncs]         
         self.len = len(self.outputs)
         self.root_dir = root_dir
@@ -55,7 +64,9 @@ class FractalDataset(data_utils.Dataset):
     def __getitem__(self, linenum):
         img_name = os.path.join(self.root_dir,
                                 "frac{}.png".format(linenum))
-        image = (Image.open(img_name)).getdata()
+        # the pngs are 1 bit grayscale (or palette images when coloured),
+        # so they are converted to 8 bit grayscale: 0 black, 255 white
+        image = (Image.open(img_name)).convert('L')
         
         data = self.outputs[linenum, :]
         sample = {'image': image, 'data': data}
@@ -72,12 +83,308 @@ class ToTensor(object):
     def __call__(self, sample, invert):
         data = torch.Tensor(sample['data'])
         image = sample['image']
-        image = (torch.Tensor(image)).reshape(3,640,640)
-        image = image[0]
-        image.unsqueeze_(0)
+        width, height = image.size
+        image = (torch.Tensor(image.getdata())).reshape(1,height,width)
         
         if (invert != 0):
             image = -1*(image - 255)
         
         return {'data': data,
                 'image': image}
+
+class FractalShardDataset(data_utils.Dataset):
+    # The class definition of a dataset stored in the binary shard
+    # files written by generatedata --shards (see shardio.h for the
+    # format). The shards are memory mapped, so an item is read
+    # straight out of the page cache with no png decoding.
+    #
+    # Items are returned in the same form as FractalDataset after
+    # ToTensor: the image is a 1 x height x width tensor that is 0
+    # on the attractor and 255 elsewhere (the other way around if
+    # invert is nonzero), and data holds the IFS parameters.
+    #
+    # INITIALIZATIONS:
+    #     root_dir:  the directory containing the shard_*.bin files
+    #     invert:    if 0, load images normally, else, invert the images
+    #     transform: a transformation that can be applied to the data as
+    #                it is loaded (it gets the sample and invert)
+
+    header = np.dtype([('magic', 'S8'), ('version', '<u4'), ('headerbytes', '<u4'),
+                       ('numsamples', '<u4'), ('firstfracnum', '<u4'),
+                       ('width', '<u4'), ('height', '<u4'), ('imagetype', '<u4'),
+                       ('numfuncs', '<u4'), ('numlabels', '<u4'), ('imagebytes', '<u4'),
+                       ('recordbytes', '<u8'), ('indexoffset', '<u8')])
+
+    def __init__(self, root_dir, invert = 0, transform=None):
+        names = [f for f in os.listdir(root_dir)
+                 if f.startswith("shard_") and f.endswith(".bin")]
+        names.sort(key = lambda f: int(f[6:-4]))
+        self.shards = []
+        self.starts = []
+        self.len = 0
+        for name in names:
+            mm = np.memmap(os.path.join(root_dir, name), dtype=np.uint8, mode='r')
+            head = np.frombuffer(mm, dtype=self.header, count=1)[0]
+            if head['magic'] != b'FRACSHD1':
+                raise ValueError("{} is not a fractal shard".format(name))
+            count = int(head['numsamples'])
+            if int(head['indexoffset']) == 0:
+                # a shard cut off by a killed run has no index yet
+                index = int(head['headerbytes']) + np.arange(count, dtype='<u8') * int(head['recordbytes'])
+            else:
+                index = np.frombuffer(mm, dtype='<u8', count=count,
+                                      offset=int(head['indexoffset']))
+            self.shards.append((mm, head, index))
+            self.starts.append(self.len)
+            self.len += count
+        self.invert = invert
+        self.transform = transform
+
+    # returns the amount of elements in the dataset
+    def __len__(self):
+        return self.len
+
+    # returns the raw record of item i: its seed, float32 labels
+    # (the fracdata.dat columns without the seed) and image array
+    def record(self, i):
+        k = np.searchsorted(self.starts, i, side='right') - 1
+        mm, head, index = self.shards[k]
+        offset = int(index[i - self.starts[k]])
+        seed = int(np.frombuffer(mm, dtype='<u8', count=1, offset=offset)[0])
+        numlabels = int(head['numlabels'])
+        labels = np.frombuffer(mm, dtype='<f4', count=numlabels, offset=offset+16)
+        width, height = int(head['width']), int(head['height'])
+        image = np.frombuffer(mm, dtype=np.uint8, count=int(head['imagebytes']),
+                              offset=offset+16+4*numlabels)
+        if head['imagetype'] == 0:
+            image = np.unpackbits(image.reshape(height, -1), axis=1)[:, :width]
+        else:
+            image = image.reshape(height, width)
+        return seed, labels, image
+
+    # returns an item linenum of the dataset as a python dictionary
+    # containing the image of an attractor and its IFS parameters
+    def __getitem__(self, linenum):
+        seed, labels, image = self.record(linenum)
+        numfuncs = int(labels[1])
+        data = torch.Tensor(labels[9:9+6*numfuncs].astype(np.float32))
+        image = torch.from_numpy(np.where(image != 0, 0, 255).astype(np.float32))
+        image.unsqueeze_(0)
+        if (self.invert != 0):
+            image = -1*(image - 255)
+        sample = {'image': image, 'data': data}
+
+        if self.transform:
+            sample = self.transform(sample, self.invert)
+
+        return sample
+
+class FracStats(ctypes.Structure):
+    # struct FracStats of libfractals.h
+    _fields_ = [('numfuncs', ctypes.c_int32), ('pointsused', ctypes.c_int32),
+                ('numb', ctypes.c_int32), ('flags', ctypes.c_int32),
+                ('avgx', ctypes.c_double), ('avgy', ctypes.c_double),
+                ('stddevx', ctypes.c_double), ('stddevy', ctypes.c_double),
+                ('dimension', ctypes.c_double), ('covxy', ctypes.c_double),
+                ('orientation', ctypes.c_double), ('window', ctypes.c_double * 4),
+                ('seed', ctypes.c_uint64)]
+
+FRAC_CUTOFF        = 1
+FRAC_AUTOFIT       = 2
+FRAC_DETERMINISTIC = 4
+FRAC_SIMD          = 8
+FRAC_FLOAT32       = 32
+
+FRACSTAT_UNCONVERGED = 1
+
+FRACLOAD_CACHE = 1
+
+class FracLib(object):
+    # A ctypes binding of libfractals.so (make libfractals.so), see
+    # libfractals.h. The library is looked for next to this file
+    # unless a path is given.
+
+    def __init__(self, path = None):
+        if path is None:
+            path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "libfractals.so")
+        self.lib = ctypes.CDLL(path)
+        dptr = ctypes.POINTER(ctypes.c_double)
+        uptr = ctypes.POINTER(ctypes.c_ubyte)
+        self.lib.fracapiversion.restype = ctypes.c_int
+        self.lib.fracapiseed.restype = ctypes.c_uint64
+        self.lib.fracapiseed.argtypes = [ctypes.c_uint64, ctypes.c_int]
+        self.lib.fracrenderseed.restype = ctypes.c_int
+        self.lib.fracrenderseed.argtypes = [ctypes.c_uint64, ctypes.c_int, ctypes.c_int,
+                                            ctypes.c_int, ctypes.c_int, dptr, ctypes.c_int,
+                                            uptr, dptr, ctypes.POINTER(FracStats)]
+        self.lib.fracrendergenome.restype = ctypes.c_int
+        self.lib.fracrendergenome.argtypes = [dptr, dptr, ctypes.c_int, ctypes.c_int,
+                                              ctypes.c_int, ctypes.c_int, dptr, ctypes.c_int,
+                                              ctypes.c_uint64, uptr, ctypes.POINTER(FracStats)]
+        if self.lib.fracapiversion() < 1:
+            raise RuntimeError("{} is too old".format(path))
+        if self.lib.fracapiversion() >= 3:
+            self.lib.fracloadmatrix.restype = ctypes.c_int
+            self.lib.fracloadmatrix.argtypes = [ctypes.c_char_p, ctypes.c_int, ctypes.POINTER(dptr),
+                                                ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int)]
+            self.lib.fracfreematrix.restype = None
+            self.lib.fracfreematrix.argtypes = [dptr]
+        if self.lib.fracapiversion() >= 4:
+            self.lib.fraccollage.restype = ctypes.c_int
+            self.lib.fraccollage.argtypes = [dptr, ctypes.c_int, ctypes.c_int, uptr, ctypes.c_int,
+                                             ctypes.c_int, dptr, ctypes.c_int, dptr]
+
+    def seed(self, masterseed, fracnum):
+        # the seed of fractal fracnum of a generatedata run
+        return self.lib.fracapiseed(masterseed, fracnum)
+
+    @staticmethod
+    def _window(window):
+        if window is None:
+            return None
+        return (ctypes.c_double * 4)(*window)
+
+    # draws the fractal of a seed and returns its image (a height x
+    # width uint8 array, 1 on the attractor), its 8*numfuncs genome
+    # columns and its FracStats
+    def render_seed(self, seed, numfuncs, numpoints, width = 640, height = 640,
+                    window = None, flags = FRAC_CUTOFF):
+        image = np.zeros((height, width), dtype=np.uint8)
+        genome = np.zeros(8*numfuncs, dtype=np.float64)
+        stats = FracStats()
+        if self.lib.fracrenderseed(seed, numfuncs, numpoints, width, height, self._window(window), flags,
+                                   image.ctypes.data_as(ctypes.POINTER(ctypes.c_ubyte)),
+                                   genome.ctypes.data_as(ctypes.POINTER(ctypes.c_double)),
+                                   ctypes.byref(stats)) != 0:
+            raise ValueError("fracrenderseed: bad arguments")
+        return image, genome, stats
+
+    # draws the fractal of 6*numfuncs parameters (and optionally
+    # numfuncs probabilities) and returns its image and FracStats
+    def render_genome(self, params, numpoints, width = 640, height = 640, probs = None,
+                      window = None, flags = 0, seed = 0):
+        params = np.ascontiguousarray(params, dtype=np.float64)
+        numfuncs = len(params)//6
+        if probs is not None:
+            probs = np.ascontiguousarray(probs, dtype=np.float64)
+            probs = probs.ctypes.data_as(ctypes.POINTER(ctypes.c_double))
+        image = np.zeros((height, width), dtype=np.uint8)
+        stats = FracStats()
+        if self.lib.fracrendergenome(params.ctypes.data_as(ctypes.POINTER(ctypes.c_double)), probs,
+                                     numfuncs, numpoints, width, height, self._window(window), flags,
+                                     seed, image.ctypes.data_as(ctypes.POINTER(ctypes.c_ubyte)),
+                                     ctypes.byref(stats)) != 0:
+            raise ValueError("fracrendergenome: bad arguments")
+        return image, stats
+
+    # reads a text matrix such as fracdata.dat into a rows x cols
+    # float64 array, keeping the parsed matrix in filename.mat so the
+    # next load is a plain read (unless cache is False)
+    def load_matrix(self, filename, cache = True):
+        matrix = ctypes.POINTER(ctypes.c_double)()
+        rows = ctypes.c_int()
+        cols = ctypes.c_int()
+        if self.lib.fracloadmatrix(os.fsencode(filename), FRACLOAD_CACHE if cache else 0,
+                                   ctypes.byref(matrix), ctypes.byref(rows), ctypes.byref(cols)) != 0:
+            raise ValueError("fracloadmatrix: cannot read {}".format(filename))
+        try:
+            return np.ctypeslib.as_array(matrix, shape=(rows.value, cols.value)).copy()
+        finally:
+            self.lib.fracfreematrix(matrix)
+
+    # scores the collages of a batch of genomes (a count x 6*numfuncs
+    # array, or one genome) on a target image (height x width, nonzero
+    # on the attractor) without drawing them, see collage.h. Returns a
+    # count x 5 array of iou, precision, recall, chamfer and hausdorff
+    def collage(self, params, target, window = None, threads = 1):
+        params = np.ascontiguousarray(np.atleast_2d(params), dtype=np.float64)
+        target = np.ascontiguousarray(target, dtype=np.uint8)
+        count, numfuncs = params.shape[0], params.shape[1]//6
+        height, width = target.shape
+        scores = np.zeros((count, 5), dtype=np.float64)
+        if self.lib.fraccollage(params.ctypes.data_as(ctypes.POINTER(ctypes.c_double)), count, numfuncs,
+                                target.ctypes.data_as(ctypes.POINTER(ctypes.c_ubyte)), width, height,
+                                self._window(window), threads,
+                                scores.ctypes.data_as(ctypes.POINTER(ctypes.c_double))) != 0:
+            raise ValueError("fraccollage: bad arguments")
+        return scores
+
+def load_fracdata(filename, cache = True, libpath = None):
+    # reads fracdata.dat with libfractals.so if it has been built, and
+    # with np.loadtxt otherwise
+    try:
+        lib = FracLib(libpath)
+    except OSError:
+        return np.loadtxt(filename, ndmin=2)
+    if lib.lib.fracapiversion() < 3:
+        return np.loadtxt(filename, ndmin=2)
+    return lib.load_matrix(filename, cache)
+
+class FractalRenderDataset(data_utils.Dataset):
+    # The class definition of a dataset that is drawn on the fly by
+    # libfractals.so instead of read from disk. Item i is fractal i
+    # of a generatedata run with master seed masterseed and the same
+    # options, so nothing has to be stored, and length can be as
+    # large as wanted. Set epoch (eg. in a worker_init_fn or between
+    # epochs) to draw fresh fractals for the same indices.
+    #
+    # Items are returned in the same form as FractalShardDataset.
+    # The library is loaded in each DataLoader worker the first time
+    # it is used there.
+    #
+    # INITIALIZATIONS:
+    #     masterseed: the master seed of the fractals
+    #     length:     the number of fractals in the dataset
+    #     numfuncs:   the number of functions in each IFS
+    #     numpoints:  the number of points drawn for each fractal
+    #     width, height, window, flags: see FracLib.render_seed
+    #     invert:     if 0, load images normally, else, invert the images
+    #     transform:  a transformation that can be applied to the data as
+    #                 it is loaded (it gets the sample and invert)
+    #     libpath:    the path to libfractals.so, if not next to this file
+
+    def __init__(self, masterseed, length, numfuncs, numpoints, width = 640, height = 640,
+                 window = None, flags = FRAC_CUTOFF, invert = 0, transform = None, libpath = None):
+        self.masterseed = masterseed
+        self.len = length
+        self.numfuncs = numfuncs
+        self.numpoints = numpoints
+        self.width = width
+        self.height = height
+        self.window = window
+        self.flags = flags
+        self.invert = invert
+        self.transform = transform
+        self.libpath = libpath
+        self.epoch = 0
+        self.lib = None
+
+    # the loaded library is not copied to DataLoader workers
+    def __getstate__(self):
+        state = self.__dict__.copy()
+        state['lib'] = None
+        return state
+
+    # returns the amount of elements in the dataset
+    def __len__(self):
+        return self.len
+
+    # returns an item linenum of the dataset as a python dictionary
+    # containing the image of an attractor and its IFS parameters
+    def __getitem__(self, linenum):
+        if self.lib is None:
+            self.lib = FracLib(self.libpath)
+        seed = self.lib.seed((self.masterseed + self.epoch) & 0xffffffffffffffff, linenum)
+        image, genome, stats = self.lib.render_seed(seed, self.numfuncs, self.numpoints, self.width,
+                                                    self.height, self.window, self.flags)
+        data = torch.Tensor(genome[:6*self.numfuncs].astype(np.float32))
+        image = torch.from_numpy(np.where(image != 0, 0, 255).astype(np.float32))
+        image.unsqueeze_(0)
+        if (self.invert != 0):
+            image = -1*(image - 255)
+        sample = {'image': image, 'data': data}
+
+        if self.transform:
+            sample = self.transform(sample, self.invert)
+
+        return sample
@@ -6,71 +6,329 @@
  * This file contains functions that are used to 
  * calculate properties from fractals as well as 
  * manipulate / mutate them for genetic algorithms
+ * (the genetic algorithm itself is in refine.c)
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
+#include <string.h>
 #include <time.h>
+#include <stdatomic.h>
 #include "Fractals.h"
 #include "fracfuncs.h"
 #include "vecio.h"
+#include "ifsrender.h"
 
-struct Fractal * makerandfrac(int numpoints, int numfuncs, double *window, int cutoff){
-    /* This function generates a random fractal. See Fractals.c -> generategenome() for an 
-     * explanation of the input parameters
-     */ 
+#define PILOTPOINTS 2000 //points in the orbit used to check the bounds of a genome
+#define PILOTMARGIN 0.1  //margin of a window fitted to a pilot orbit
+#define FITMARGIN   0.02 //margin of a window fitted to the full orbit
+#define BOXLEVELS   16   //most box sizes counted for the dimension
+#define BOXMINSIDE  4    //the largest boxes used still split the image this many ways
+#define CORRPOINTS  1000 //orbit points used for the correlation dimension
+#define CORRFIRST   2    //the correlation dimension is fitted over radii
+#define CORRLAST    7    //D/2^CORRFIRST to D/2^CORRLAST, D the orbit's diameter
+
+static struct Fractal * newfrac(struct FracConfig *cfg){
+    /* This function allocates a fractal for a config */
     struct Fractal *frac;
     if ((frac = (struct Fractal *)malloc(sizeof(struct Fractal))) == NULL){
-        fprintf(stderr, "Malloc failed. (makerandfrac)\n");
+        fprintf(stderr, "Malloc failed. (makefrac)\n");
         exit(1);
     }
-    initializefrac(frac, numfuncs, numpoints);
-    double *extrema = dvecmem(4);
+    initfrac(frac, cfg);
+    return frac;
+}
+
+struct Fractal * makefrac(struct FracConfig *cfg, uint64_t seed){
+    /* This function generates the fractal given by a seed in a
+     * newly allocated fractal, see remakefrac()
+     */
+    struct Fractal *frac = newfrac(cfg);
+    remakefrac(frac, cfg, seed);
+    return frac;
+}
+
+void remakefrac(struct Fractal *frac, struct FracConfig *cfg, uint64_t seed){
+    /* This function generates the fractal given by a seed into a
+     * fractal made by initfrac or makefrac, reusing its memory (see
+     * resetfrac), so a worker can draw any number of fractals with
+     * one. All the
+     * randomness used (genome, starting point, function choices and
+     * cutoff retries) comes from the fractal's own stream, so the
+     * same config and seed always give the same fractal.
+     * See Fractals.c -> generategenome() for an explanation of the
+     * config parameters
+     *
+     * If cfg -> cutoff is set the attractor has to lie inside
+     * cfg -> window, and with ENGINE_IFS its measure has to have
+     * settled (see generateifs), otherwise the genome is redrawn. If cfg -> autofit is set the fractal is drawn
+     * in a square window fitted tightly around it, which is stored
+     * in frac -> window.
+     */
+    resetfrac(frac, cfg);
+    frac -> seed = seed;
+    seedrand(&frac -> rng, seed);
+    double *window = cfg -> window;
+    double extrema[4], pilot[4];
+    struct Rand saved;
     int pass = 1;
     while (pass != 0){
 	    generategenome(frac);
-	    generatefrac(frac, extrema);
-	    if (cutoff == 0) pass = 0;
-	    if (extrema[0] > window[0] && extrema[1] < window[1]){
-		if (extrema[2] > window[2] && extrema[3] < window[3]){
-		    pass = 0;
+	    /* Cheap checks that reject most genomes whose attractor
+	     * leaves the window before the full chaos game is run */
+	    if (cfg -> cutoff != 0 && fixedpointsinside(frac, window) == 0) continue;
+	    if (cfg -> cutoff != 0 || cfg -> autofit != 0){
+		pilotorbit(frac, pilot, PILOTPOINTS);
+		if (cfg -> cutoff != 0 && insidewindow(pilot, window) == 0) continue;
+	    }
+	    if (cfg -> cutoff != 0 && frac -> engine == ENGINE_IFS && ifsinside(frac, window) == 0) continue;
+	    if (frac -> stream != 0){
+		/* A streamed fractal is drawn as it is generated, so its
+		 * window is fitted from the pilot orbit. If the full orbit
+		 * turns out to be larger it is refitted and replayed */
+		if (cfg -> autofit != 0) fitwindow(frac -> window, pilot, PILOTMARGIN);
+		saved = frac -> rng;
+		generatestream(frac, frac -> window, extrema);
+		if (cfg -> autofit != 0 && insidewindow(extrema, frac -> window) == 0){
+		    fitwindow(frac -> window, extrema, FITMARGIN);
+		    frac -> rng = saved;
+		    generatestream(frac, frac -> window, extrema);
 		}
 	    }
+	    else generatefrac(frac, extrema);
+	    if (cfg -> cutoff != 0 && frac -> converged == 0) continue;
+	    if (cfg -> cutoff == 0) pass = 0;
+	    if (insidewindow(extrema, window)) pass = 0;
+    }
+    if (frac -> stream == 0){
+	if (cfg -> autofit != 0) fitwindow(frac -> window, extrema, FITMARGIN);
+	generatematrix(frac, frac -> window);
     }
-    generatematrix(frac, window);
-    free(extrema);
+}
+
+struct Fractal * makefracgenome(struct FracConfig *cfg, const double *params, const double *probs, uint64_t seed){
+    /* This function draws the fractal of a given genome in a newly
+     * allocated fractal, see remakefracgenome()
+     */
+    struct Fractal *frac = newfrac(cfg);
+    remakefracgenome(frac, cfg, params, probs, seed);
     return frac;
 }
 
+void remakefracgenome(struct Fractal *frac, struct FracConfig *cfg, const double *params, const double *probs, uint64_t seed){
+    /* This function draws the fractal of a given genome, eg. one
+     * predicted by a network. params holds the 4 multiplicative
+     * parameters of every function followed by their 2 additive ones,
+     * as in fracdata.dat, and probs their probabilities. If probs is
+     * NULL the probabilities are the normalized spectral radii, as in
+     * generategenome, or equal if a function is not contractive.
+     * The functions are kept in the order given. The seed only sets
+     * the random stream of the chaos game.
+     *
+     * There is no cutoff since the genome can not be redrawn, but
+     * cfg -> autofit fits the window to the attractor as in makefrac.
+     * frac is reused as in remakefrac.
+     */
+    double extrema[4], pilot[4];
+    struct Rand saved;
+    int i, n = cfg -> numfuncs;
+    double sumspecrad = 0;
+    resetfrac(frac, cfg);
+    frac -> seed = seed;
+    seedrand(&frac -> rng, seed);
+    for (i = 0; i < 4*n; i++) frac -> genome[0][i] = params[i];
+    for (i = 0; i < 2*n; i++) frac -> genome[1][i] = params[4*n + i];
+    for (i = 0; i < n; i++){
+        frac -> genome[3][i] = validatefunc(params[4*i], params[4*i+1], params[4*i+2], params[4*i+3]);
+        sumspecrad += frac -> genome[3][i];
+    }
+    for (i = 0; i < n; i++){
+        if (probs != NULL) frac -> genome[2][i] = probs[i];
+        else if (sumspecrad > 0 && frac -> genome[3][i] > 0) frac -> genome[2][i] = frac -> genome[3][i]/sumspecrad;
+        else break;
+    }
+    if (i < n){
+        for (i = 0; i < n; i++) frac -> genome[2][i] = 1.0/n;
+    }
+    if (cfg -> autofit != 0){
+        pilotorbit(frac, pilot, PILOTPOINTS);
+        fitwindow(frac -> window, pilot, PILOTMARGIN);
+    }
+    if (frac -> stream != 0){
+        saved = frac -> rng;
+        generatestream(frac, frac -> window, extrema);
+        if (cfg -> autofit != 0 && insidewindow(extrema, frac -> window) == 0){
+            fitwindow(frac -> window, extrema, FITMARGIN);
+            frac -> rng = saved;
+            generatestream(frac, frac -> window, extrema);
+        }
+    }
+    else {
+        generatefrac(frac, extrema);
+        if (cfg -> autofit != 0) fitwindow(frac -> window, extrema, FITMARGIN);
+        generatematrix(frac, frac -> window);
+    }
+}
+
+struct Fractal * makerandfrac(int numpoints, int numfuncs, double *window, int cutoff){
+    /* This function generates a random fractal from a seed that
+     * differs on every call. Use makefrac() to be able to
+     * regenerate the fractal later.
+     */
+    static atomic_int calls = 0;
+    struct FracConfig cfg;
+    defaultconfig(&cfg, numfuncs, numpoints);
+    cfg.cutoff = cutoff;
+    for (int i = 0; i < 4; i++) cfg.window[i] = window[i];
+    return makefrac(&cfg, fracseed((uint64_t)time(NULL), atomic_fetch_add(&calls, 1)));
+}
+
+static double fitslope(double *xs, double *ys, int n){
+    /* This function returns the least squares slope of ys against xs */
+    int i;
+    double mx = 0, my = 0, sxy = 0, sxx = 0;
+    for (i = 0; i < n; i++){
+        mx += xs[i];
+        my += ys[i];
+    }
+    mx /= n;
+    my /= n;
+    for (i = 0; i < n; i++){
+        sxy += (xs[i] - mx) * (ys[i] - my);
+        sxx += (xs[i] - mx) * (xs[i] - mx);
+    }
+    return (sxx > 0) ? sxy/sxx : 0;
+}
+
 void dimension(struct Fractal *frac){
-    /* This function calculates an estimate of the
-     * fractal dimension for a fractal, based on its
-     * corresponding number of pixels, and stores it
-     * in the fractal struct.
+    /* This function calculates the box counting dimension of a
+     * fractal from its image, and stores it in the fractal struct.
+     * The boxes are 1, 2, 4, ... pixels wide (see bmboxcounts),
+     * down to boxes that split the shorter side of the image
+     * BOXMINSIDE ways, and the dimension is the slope of log(count)
+     * against log(1/size). If there are too few box sizes the old
+     * single scale estimate log(numb)/log(width) is used.
+     */
+    double counts[BOXLEVELS], xs[BOXLEVELS], ys[BOXLEVELS];
+    int k, n = 0;
+    int side = (frac -> bm.width < frac -> bm.height) ? frac -> bm.width : frac -> bm.height;
+    int levels = bmboxcounts(&frac -> bm, counts, BOXLEVELS);
+    for (k = 0; k < levels && (side >> k) >= BOXMINSIDE && counts[k] > 0; k++){
+        xs[n] = -k * log(2.0);
+        ys[n] = log(counts[k]);
+        n++;
+    }
+    if (n >= 2){
+        frac -> dimension = fitslope(xs, ys, n);
+    }
+    else {
+        frac -> dimension = (log(((double)frac -> numb))/log(((double)frac -> bm.width)));
+    }
+    return;
+}
+
+void corrdimension(struct Fractal *frac){
+    /* This function calculates the correlation dimension of a fractal
+     * from CORRPOINTS points of its orbit, and stores it in the
+     * fractal struct. C(r), the fraction of pairs of points closer
+     * than r, is counted for r = D/2^k with D the diameter of the
+     * points, by binning every pair by the floating point exponent of
+     * its squared distance (in units of D). The dimension is the slope of log C(r) against log r
+     * for k from CORRFIRST to CORRLAST. The orbit has its own random
+     * stream, made from the seed, so the fractal's stream is untouched.
      */
-    frac -> dimension = (log(((double)frac -> numb))/log(((double)WIDTH)));
+    double xs[CORRPOINTS], ys[CORRPOINTS];
+    int funcs[CORRPOINTS];
+    long bins[2*CORRLAST + 2] = {0};
+    double lx[CORRLAST], ly[CORRLAST];
+    struct Rand rng;
+    int i, j, k, e, n = 0;
+    double x, y, diam2, minx, maxx, miny, maxy;
+    seedrand(&rng, frac -> seed ^ 0x636f7272ULL);
+    x = randdouble(&rng);
+    y = randdouble(&rng);
+    selectfuncs(frac, &rng, funcs, CORRPOINTS, 1);
+    for (i = 0; i < 100; i++){
+        func(&x, &y, frac -> genome, funcs[i]);
+    }
+    selectfuncs(frac, &rng, funcs, CORRPOINTS, 1);
+    minx = maxx = x;
+    miny = maxy = y;
+    for (i = 0; i < CORRPOINTS; i++){
+        func(&x, &y, frac -> genome, funcs[i]);
+        xs[i] = x;
+        ys[i] = y;
+        if (x < minx) minx = x;
+        if (x > maxx) maxx = x;
+        if (y < miny) miny = y;
+        if (y > maxy) maxy = y;
+    }
+    diam2 = (maxx - minx) * (maxx - minx) + (maxy - miny) * (maxy - miny);
+    if (diam2 <= 0){
+        frac -> corrdim = 0;
+        return;
+    }
+    double scale = 1/sqrt(diam2);
+    for (i = 0; i < CORRPOINTS; i++){
+        xs[i] *= scale;
+        ys[i] *= scale;
+    }
+    //bins[b] counts the pairs with D/2^(b+1) < distance <= D/2^b,
+    //b = (1022 - exponent of d2)/2
+    for (i = 0; i < CORRPOINTS; i++){
+        for (j = i + 1; j < CORRPOINTS; j++){
+            double dx = xs[i] - xs[j], dy = ys[i] - ys[j];
+            double d2 = dx * dx + dy * dy;
+            uint64_t bits;
+            memcpy(&bits, &d2, sizeof(bits));
+            e = (1022 - (int)(bits >> 52))/2;
+            if (e < 0) e = 0;
+            if (e > 2*CORRLAST + 1) e = 2*CORRLAST + 1;
+            bins[e] += 1;
+        }
+    }
+    //C(D/2^k) counts the pairs in bins k and up
+    double pairs = 0.5 * CORRPOINTS * (CORRPOINTS - 1);
+    double within = 0;
+    for (k = 2*CORRLAST + 1; k >= CORRFIRST; k--){
+        within += bins[k];
+        if (k <= CORRLAST && within > 0){
+            lx[n] = -k * log(2.0);
+            ly[n] = log(within/pairs);
+            n++;
+        }
+    }
+    frac -> corrdim = (n >= 2) ? fitslope(lx, ly, n) : 0;
     return;
 }
 
 void stddev(struct Fractal *frac){
     /* This function calculates the standard deviation of the
-     * pixels corresponding to a fractal, in both the x and y 
-     * direction, based on the image of the fractal. It then
-     * stores these values in the fractal struct.
+     * pixels corresponding to a fractal, in both the x and y
+     * direction, along with their covariance and orientation (the
+     * angle of their major axis from the x axis, in radians, with y
+     * pointing down the image). It uses the coordinate sums kept as
+     * the pixels were drawn (see stamppoints), so the image is not
+     * read again, and stores these values in the fractal struct.
      */
-    int i,j;
-    double stddevx = 0;
-    double stddevy = 0;
-    for (i = 0; i < HEIGHT; i++){
-        for (j = 0; j < WIDTH; j++){
-            if ((frac -> bm[i][j]) == 0){
-                stddevx += (j - frac -> avgx) * (j - frac -> avgx);
-                stddevy += (i - frac -> avgy) * (i - frac -> avgy);
-            }
-        }
+    double n = frac -> numb;
+    if (frac -> numb < 2){
+        frac -> stddevx = 0;
+        frac -> stddevy = 0;
+        frac -> covxy = 0;
+        frac -> orientation = 0;
+        return;
     }
-    frac -> stddevx = sqrt(stddevx/((double)(frac -> numb -1)));
-    frac -> stddevy = sqrt(stddevy/((double)(frac -> numb -1)));
+    //the sums of squared deviations, from the exact integer sums
+    double ssx  = frac -> sumxx - (double)frac -> sumx * frac -> sumx / n;
+    double ssy  = frac -> sumyy - (double)frac -> sumy * frac -> sumy / n;
+    double ssxy = frac -> sumxy - (double)frac -> sumx * frac -> sumy / n;
+    if (ssx < 0) ssx = 0;
+    if (ssy < 0) ssy = 0;
+    frac -> stddevx = sqrt(ssx/(n - 1));
+    frac -> stddevy = sqrt(ssy/(n - 1));
+    frac -> covxy = ssxy/(n - 1);
+    frac -> orientation = 0.5 * atan2(2 * ssxy, ssx - ssy);
     return;
 }
@@ -3,7 +3,14 @@
  *
  * FILE NAME: fracfuncs.h
  */
+#include <stdint.h>
 struct Fractal;
+struct FracConfig;
+struct Fractal * makefrac(struct FracConfig *cfg, uint64_t seed);
+void remakefrac(struct Fractal *frac, struct FracConfig *cfg, uint64_t seed);
+struct Fractal * makefracgenome(struct FracConfig *cfg, const double *params, const double *probs, uint64_t seed);
+void remakefracgenome(struct Fractal *frac, struct FracConfig *cfg, const double *params, const double *probs, uint64_t seed);
 struct Fractal * makerandfrac(int numpoints, int numfuncs, double *window, int cutoff);
 void dimension(struct Fractal *frac);
+void corrdimension(struct Fractal *frac);
 void stddev(struct Fractal *frac);
@@ -0,0 +1,30 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: fracrand.c
+ *
+ * This file contains the functions used to seed the
+ * random number generator in fracrand.h
+ */
+#include <stdint.h>
+#include "fracrand.h"
+
+void seedrand(struct Rand *rng, uint64_t seed){
+    /* This function sets the state of a generator from a
+     * single seed. The same seed always gives the same stream.
+     */
+    uint64_t state = seed;
+    for (int i = 0; i < 4; i++){
+        rng -> s[i] = splitmix64(&state);
+    }
+}
+
+uint64_t fracseed(uint64_t masterseed, int fracnum){
+    /* This function computes the seed of fractal fracnum in a
+     * dataset generated with the given master seed. Seeds are
+     * kept to SEEDBITS bits so they are stored exactly when the
+     * data file is read as doubles.
+     */
+    uint64_t state = masterseed * 0x9E3779B97F4A7C15ULL + (uint64_t)fracnum;
+    return splitmix64(&state) & ((1ULL << SEEDBITS) - 1);
+}
@@ -0,0 +1,64 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: fracrand.h
+ *
+ * A small, fast random number generator (xoshiro256**) whose
+ * state is carried around explicitly, so that every fractal
+ * has its own stream and can be regenerated from its seed.
+ * The generators are inlined since they are called once per
+ * point of the chaos game.
+ */
+#ifndef FRACRAND_H
+#define FRACRAND_H
+
+#include <stdint.h>
+
+#define SEEDBITS 53 //seeds fit in a double so they survive np.loadtxt
+
+struct Rand{
+    uint64_t s[4];
+};
+
+static inline uint64_t splitmix64(uint64_t *state){
+    /* This function is used to expand a single seed into
+     * the state of the generator
+     */
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t rotl64(uint64_t x, int k){
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t nextrand(struct Rand *rng){
+    /* This function returns the next 64 random bits of the stream */
+    uint64_t *s = rng -> s;
+    uint64_t result = rotl64(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl64(s[3], 45);
+    return result;
+}
+
+static inline double randdouble(struct Rand *rng){
+    /* This function returns a random double in [0,1) */
+    return (double)(nextrand(rng) >> 11) * 0x1.0p-53;
+}
+
+static inline int randint(struct Rand *rng, int n){
+    /* This function returns a random integer in [0,n) */
+    return (int)(((nextrand(rng) >> 32) * (uint64_t)n) >> 32);
+}
+
+void seedrand(struct Rand *rng, uint64_t seed);
+uint64_t fracseed(uint64_t masterseed, int fracnum);
+
+#endif
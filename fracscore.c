@@ -0,0 +1,177 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: fracscore.c
+ *
+ * This file contains the scoring of a predicted picture against a
+ * target, see fracscore.h. The overlap is counted a word at a time.
+ * The distances come from an exact euclidean distance transform
+ * that takes linear time: the distance to the nearest set pixel in
+ * the same column is found with a pass down and a pass up, then
+ * along each row the squared distance is the lower envelope of the
+ * parabolas (x - q)^2 + g(q)^2 of the columns q (Felzenszwalb and
+ * Huttenlocher). The nearest pixel of either picture is always
+ * inside the box around both, so only that box is transformed, and
+ * only rows holding pixels of the other picture are enveloped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "fracscore.h"
+
+static __thread int *colscratch = NULL;  //the column distances of a transform, per thread
+static __thread size_t colcells = 0;
+static __thread double *rowscratch = NULL; //the envelope of a row
+static __thread size_t rowcells = 0;
+
+static void *growscratch(void *p, size_t *have, size_t need, size_t size){
+    /* This function makes a scratch buffer at least need elements long */
+    if (*have >= need) return p;
+    free(p);
+    if ((p = malloc(need * size)) == NULL){
+        fprintf(stderr, "Malloc failed. (scorebitmaps)\n");
+        exit(1);
+    }
+    *have = need;
+    return p;
+}
+
+static inline int bit(const uint64_t *row, int x){
+    return (row[x >> 6] >> (x & 63)) & 1;
+}
+
+static void distances(const struct Bitmap *src, const struct Bitmap *dst, const int *box,
+                      double *sum, double *most){
+    /* This function adds up the distances from the pixels of dst to
+     * the nearest pixel of src, which must not be empty, and finds
+     * the largest. box is minx, maxx, miny, maxy of both pictures
+     */
+    int x, y, k, q;
+    int w = box[1] - box[0] + 1, h = box[3] - box[2] + 1;
+    int far = w + h; //further than any pixel of the box
+    int *g, *v;
+    double *z, *f;
+    colscratch = (int *)growscratch(colscratch, &colcells, (size_t)w * h + w, sizeof(int));
+    rowscratch = (double *)growscratch(rowscratch, &rowcells, 2 * (size_t)w + 1, sizeof(double));
+    g = colscratch;
+    v = colscratch + (size_t)w * h;
+    z = rowscratch;
+    f = rowscratch + w + 1;
+    *sum = 0;
+    *most = 0;
+
+    /* g is the distance to the nearest pixel of src in the column */
+    for (y = 0; y < h; y++){
+        const uint64_t *row = (const uint64_t *)src -> data + (size_t)(box[2] + y) * src -> stride;
+        int *gy = g + (size_t)y * w;
+        for (x = 0; x < w; x++){
+            if (bit(row, box[0] + x)) gy[x] = 0;
+            else gy[x] = (y == 0 || gy[x - w] >= far) ? far : gy[x - w] + 1;
+        }
+    }
+    for (y = h - 2; y >= 0; y--){
+        int *gy = g + (size_t)y * w;
+        for (x = 0; x < w; x++){
+            if (gy[x + w] + 1 < gy[x]) gy[x] = gy[x + w] + 1;
+        }
+    }
+
+    for (y = 0; y < h; y++){
+        const uint64_t *row = (const uint64_t *)dst -> data + (size_t)(box[2] + y) * dst -> stride;
+        const int *gy = g + (size_t)y * w;
+        int j0 = box[0] >> 6, j1 = box[1] >> 6, j;
+        uint64_t any = 0;
+        for (j = j0; j <= j1; j++) any |= row[j];
+        if (any == 0) continue;
+
+        /* The lower envelope of the parabolas of the columns that have
+         * a pixel of src, parabola k starting at z[k] */
+        k = -1;
+        for (q = 0; q < w; q++){
+            if (gy[q] >= far) continue;
+            f[q] = (double)gy[q] * gy[q];
+            double s = 0;
+            while (k >= 0){
+                s = ((f[q] + (double)q * q) - (f[v[k]] + (double)v[k] * v[k]))/(2.0 * (q - v[k]));
+                if (s > z[k]) break;
+                k--;
+            }
+            k++;
+            v[k] = q;
+            z[k] = (k == 0) ? -HUGE_VAL : s;
+        }
+        z[k + 1] = HUGE_VAL;
+
+        /* Walk the pixels of dst along the row and the envelope together */
+        k = 0;
+        for (j = j0; j <= j1; j++){
+            uint64_t bits = row[j];
+            while (bits != 0){
+                x = 64*j + __builtin_ctzll(bits) - box[0];
+                bits &= bits - 1;
+                while (z[k + 1] < x) k++;
+                double d = sqrt((double)(x - v[k]) * (x - v[k]) + f[v[k]]);
+                *sum += d;
+                if (d > *most) *most = d;
+            }
+        }
+    }
+}
+
+void scorebitmaps(const struct Bitmap *pred, const struct Bitmap *target, struct Score *score){
+    /* This function scores the bit map pred against target, which
+     * must be the same size, see fracscore.h
+     */
+    int y, j, box[4];
+    long common = 0, np = 0, nt = 0;
+    double diagonal = sqrt((double)pred -> width * pred -> width + (double)pred -> height * pred -> height);
+    double sumpt, mostpt, sumtp, mosttp;
+    box[0] = pred -> width;
+    box[1] = -1;
+    box[2] = pred -> height;
+    box[3] = -1;
+    for (y = 0; y < pred -> height; y++){
+        const uint64_t *p = (const uint64_t *)pred -> data + (size_t)y * pred -> stride;
+        const uint64_t *t = (const uint64_t *)target -> data + (size_t)y * target -> stride;
+        uint64_t rowany = 0;
+        for (j = 0; j < pred -> stride; j++){
+            uint64_t u = p[j] | t[j];
+            common += __builtin_popcountll(p[j] & t[j]);
+            np += __builtin_popcountll(p[j]);
+            nt += __builtin_popcountll(t[j]);
+            if (u == 0) continue;
+            rowany = 1;
+            if (64*j + __builtin_ctzll(u) < box[0]) box[0] = 64*j + __builtin_ctzll(u);
+            if (64*j + 63 - __builtin_clzll(u) > box[1]) box[1] = 64*j + 63 - __builtin_clzll(u);
+        }
+        if (rowany){
+            if (y < box[2]) box[2] = y;
+            box[3] = y;
+        }
+    }
+    score -> predpixels   = np;
+    score -> targetpixels = nt;
+    score -> common       = common;
+    score -> iou       = (np + nt - common > 0) ? (double)common/(np + nt - common) : 1;
+    score -> precision = (np > 0) ? (double)common/np : (nt > 0) ? 0 : 1;
+    score -> recall    = (nt > 0) ? (double)common/nt : (np > 0) ? 0 : 1;
+    if (np == 0 || nt == 0){
+        score -> chamfer = score -> hausdorff = (np == nt) ? 0 : diagonal;
+        return;
+    }
+    distances(target, pred, box, &sumpt, &mostpt);
+    distances(pred, target, box, &sumtp, &mosttp);
+    score -> chamfer   = (sumpt/np + sumtp/nt)/2;
+    score -> hausdorff = (mostpt > mosttp) ? mostpt : mosttp;
+}
+
+void scorethreadfree(void){
+    /* This function frees the scratch of the calling thread */
+    free(colscratch);
+    free(rowscratch);
+    colscratch = NULL;
+    rowscratch = NULL;
+    colcells = 0;
+    rowcells = 0;
+}
@@ -0,0 +1,30 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: fracscore.h
+ *
+ * How close a predicted picture is to a target picture. Both are
+ * PIX_BIT bit maps of the same size, and distances are in pixels,
+ * between pixel centres.
+ *
+ * The chamfer distance is the mean distance from a pixel of one
+ * picture to the nearest pixel of the other, averaged over the two
+ * directions, and the hausdorff distance is the largest such
+ * distance. If only one of the pictures is empty both are the
+ * length of the diagonal of the image.
+ */
+#ifndef FRACSCORE_H
+#define FRACSCORE_H
+
+#include "bitmap.h"
+
+struct Score{
+    long predpixels, targetpixels, common;
+    double iou, precision, recall;
+    double chamfer, hausdorff;
+};
+
+void scorebitmaps(const struct Bitmap *pred, const struct Bitmap *target, struct Score *score);
+void scorethreadfree(void);
+
+#endif
@@ -2,82 +2,825 @@
  * Last updated: Jan 2021
  *
  * FILE NAME: generatedata.c
- * 
+ *
  * This is the main file that, when run,
  * generates databases of fractals
+ *
+ * Fractals are generated by a pool of worker threads
+ * (see --threads). Each worker claims the next fractal
+ * number, builds the fractal and writes its png, then
+ * hands the formatted fracdata.dat line to the main thread
+ * through a ring of slots. The main thread commits the
+ * lines strictly in fractal number order, so the file
+ * matches the frac%d.png numbering exactly.
+ *
+ * Every fractal is generated from its own seed, derived from
+ * the master seed (--seed) and the fractal number. The seed is
+ * the last column of fracdata.dat and any fractal can be
+ * regenerated from it with --render SEED FILE.
+ *
+ * With --stream the points of each fractal are drawn as they
+ * are generated rather than stored, which gives the same images
+ * with about 20 bytes less memory per point.
+ *
+ * With --adaptive (which implies --stream) --points is only a cap:
+ * a fractal stops once a window of --adapt-window points (10000)
+ * covers fewer than --adapt-rate new pixels per point (0.0005),
+ * after at least --min-points points (20000). The third column of
+ * fracdata.dat is the number of points actually used.
+ *
+ * With --autofit each fractal is drawn in its own square window
+ * fitted around the attractor instead of the fixed [-8,8] window.
+ * The window used is written after the seed in fracdata.dat.
+ *
+ * With --simd the chaos game is run as several orbits side by
+ * side in simd registers (see chaossimd.c). --precision float
+ * (which implies --simd) runs them in 32 bit floats instead of
+ * doubles; checkprecision measures how many pixels that changes.
+ * --render needs the same precision.
+ *
+ * With --deterministic there is no chaos game: the picture is the
+ * pixels a chaos game of --points points is expected to hit, worked
+ * out from the invariant measure of the IFS (see ifsrender.c), which
+ * needs no random numbers. The third column of fracdata.dat is then
+ * the number of points mapped. If the measure of a genome does not
+ * settle its picture may be missing pixels: with the cutoff the
+ * genome is redrawn, without it the fractal is kept with a warning
+ * and SHARD_UNCONVERGED in its shard record (see shardio.h).
+ * It only draws black fractals, not --coloured or --density ones.
+ *
+ * Images are WIDTH x HEIGHT unless --resolution is given. With
+ * --coloured the pixel map keeps which function drew each pixel and
+ * the pngs are coloured by function, otherwise one bit is kept per
+ * pixel. --tiled stores coloured pixel maps in 8x8 tiles.
+ *
+ * With --density 16 or --density 32 the pixel map counts the points
+ * that land on each pixel (in 16 bit, saturating, or 32 bit counts)
+ * and the pngs are gray, darker where the attractor's measure is
+ * higher, using --tone log (the default) or --tone gamma G, in 8 bit
+ * or --png-depth 16 bit. Every worker counts into its own fractal's
+ * pixel map, so no counts are shared between threads.
+ *
+ * --supersample S draws black fractals on an S times finer grid and
+ * shades each pixel by how many of its S x S subpixels were hit,
+ * which anti-aliases the image.
+ *
+ * --pyramid W1,W2,... also writes each black fractal at the smaller
+ * widths W1, W2, ..., which must divide the width (and the height by
+ * the same factor), into DIR/WxH/frac%d.png and DIR/WxH/shard_F.bin.
+ * They are not drawn again: every pixel of a level is the OR of the
+ * block of pixels over it in the next larger level it divides (see
+ * bmshrink), so one orbit makes them all, a level is set wherever
+ * the picture is, and fracdata.dat holds the one set of labels.
+ *
+ * With --shards N the fractals are also written to binary shard
+ * files (see shardio.h) of N fractals each, named shard_F.bin
+ * where F is the number of their first fractal. --no-png skips
+ * writing the pngs.
+ *
+ * The zlib level and png row filters can be set with --png-level
+ * and --png-filter; --png-fast trades file size for speed.
+ *
+ * The run itself is set with --count, --dir, --points, --funcs
+ * and --window (any left out are asked for), or with --job FILE,
+ * a file of the same options one per line without the dashes, eg.
+ *
+ *      count 250000
+ *      dir data
+ *      points 100000
+ *      funcs 4
+ *      threads 8
+ *
+ * Options after --job override the ones in the file. --no-cutoff
+ * keeps fractals whose attractor leaves the window.
+ *
+ * The dimension column is a box counting estimate from the image.
+ * --corrdim also fills in the last column with the correlation
+ * dimension of the orbit (it is -1 otherwise).
+ *
+ * Runs append to fracdata.dat and can be killed and restarted at
+ * any time. The number of committed lines is kept in fracdata.idx
+ * (see manifest.h) so a restart does not reread fracdata.dat, and
+ * a line cut off by the kill is dropped. Pngs are written to a
+ * temporary file by the workers and renamed by the main thread just
+ * before it commits their line, and shard records are appended just
+ * before too. So every committed line has its png and its records,
+ * no png is ever half written, and a restart deletes the temporary
+ * files and any png past the committed lines, and carries on the
+ * shard holding the next line (see shardresume).
  */
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 #include <time.h>
 #include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <png.h>
+#include <zlib.h>
 #include "Fractals.h"
 #include "vecio.h"
 #include "PNGio.h"
 #include "fracfuncs.h"
+#include "shardio.h"
+#include "manifest.h"
+
+#define SLOTSPERTHREAD 4 //how far workers may run ahead of the committer
+#define MAXLEVELS 8      //smaller resolutions --pyramid may ask for
+#define LINESIZE(numfuncs) (64 * (32 + 7 * (numfuncs))) //room for a fracdata.dat line
+
+struct Options{
+    int numthreads, numtogenerate, numpoints, numfuncs;
+    int seedgiven, shardsize, writepng, corrdim;
+    int pnglevel, pngfilters, pngstrategy;
+    int tone, tonedepth;
+    double gamma;
+    int numlevels, levelwidth[MAXLEVELS]; //the --pyramid widths
+    uint64_t masterseed, renderseed;
+    char *renderfile;
+    char dirname[256];
+    struct FracConfig cfg;
+};
+
+struct Slot{
+    pthread_mutex_t lock;  //guards turn and ready
+    pthread_cond_t change; //broadcast when either changes
+    int turn;              //the fractal that may write the slot next
+    int ready;             //set once that fractal is written
+    char *line;
+    unsigned char *record; //shard record, if shards are written
+    unsigned char *levelrecords[MAXLEVELS]; //and those of the pyramid levels
+};
+
+struct Pool{
+    int numtogenerate, firstrow, numslots;
+    int shardsize, imagetype, writepng, corrdim;
+    uint64_t masterseed;
+    size_t linesize, recordsize;
+    int numlevels;         //the pyramid levels, largest first
+    int levelwidth[MAXLEVELS], levelheight[MAXLEVELS];
+    size_t levelrecordsize[MAXLEVELS];
+    struct FracConfig *cfg;
+    char *dirname;
+    struct Slot *slots;
+    atomic_int next;       //next fractal to be claimed by a worker
+};
+
+static size_t lineprintf(char *line, size_t size, size_t n, const char *format, ...){
+    /* This function appends to a line of size bytes holding n
+     * characters and returns its new length. Once the line is full
+     * nothing more is appended, so a cut off line is never overrun
+     */
+    va_list args;
+    if (n >= size) return n;
+    va_start(args, format);
+    n += vsnprintf(line + n, size - n, format, args);
+    va_end(args);
+    return n;
+}
+
+static void fracdataline(char *line, size_t size, struct Fractal *frac){
+    /* This function formats the fracdata.dat line of a fractal in
+     * the order:
+     * fractal number, numfuncs, points used, numb, avgx, avgy, stddevx, stddevy, dimension, genome, seed, window,
+     * covxy, orientation, corrdim
+     */
+    int j;
+    size_t n = 0;
+    n = lineprintf(line, size, n, "%d\t%d\t%d\t%d\t%.15lf\t%.15lf\t%.15lf\t%.15lf\t%.15lf\t", frac->fracnum, frac->numfuncs, frac->pointsused, frac->numb, frac->avgx, frac->avgy, frac->stddevx, frac->stddevy, frac -> dimension);
+    for (j = 0; j < 4 * frac -> numfuncs; j++){
+        n = lineprintf(line, size, n, "%.15lf\t", frac -> genome[0][j]);
+    }
+    for (j = 0; j < 2 * frac -> numfuncs; j++){
+        n = lineprintf(line, size, n, "%.15lf\t", frac -> genome[1][j]);
+    }
+    for (j = 0; j < frac -> numfuncs; j++){
+        n = lineprintf(line, size, n, "%.15lf\t", frac -> genome[2][j]);
+    }
+    for (j = 0; j < frac -> numfuncs-1; j++){
+        n = lineprintf(line, size, n, "%.15lf\t", frac -> genome[3][j]);
+    }
+    n = lineprintf(line, size, n, "%.15lf\t%llu\t", frac -> genome[3][frac -> numfuncs -1], (unsigned long long)frac -> seed);
+    n = lineprintf(line, size, n, "%.15lf\t%.15lf\t%.15lf\t%.15lf\t", frac -> window[0], frac -> window[1], frac -> window[2], frac -> window[3]);
+    lineprintf(line, size, n, "%.15lf\t%.15lf\t%.15lf\n", frac -> covxy, frac -> orientation, frac -> corrdim);
+}
+
+static void unconverged(struct Fractal *frac){
+    /* This function warns that the deterministic picture of a
+     * fractal did not settle, see generateifs
+     */
+    fprintf(stderr, "Warning: the measure of fractal %d did not settle, its picture may be missing pixels\n",
+            frac -> fracnum);
+}
+
+static void pngname(char *name, size_t size, const char *dir, int fracnum, int temporary){
+    /* This function makes the name of the png of a fractal, or of the
+     * temporary file it is written to before its line is committed
+     */
+    snprintf(name, size, "%s/frac%d.png%s", dir, fracnum, temporary ? ".tmp" : "");
+}
+
+static void commitpng(const char *dir, int fracnum){
+    /* This function renames the temporary png of a fractal to its png */
+    char tmpname[340], fracname[340];
+    pngname(tmpname, sizeof(tmpname), dir, fracnum, 1);
+    pngname(fracname, sizeof(fracname), dir, fracnum, 0);
+    if (rename(tmpname, fracname) != 0){
+        fprintf(stderr, "Failed to rename %s to %s\n", tmpname, fracname);
+        exit(1);
+    }
+}
+
+static void removeorphans(const char *dir, int rows){
+    /* This function deletes the temporary pngs in dir, and the pngs of
+     * fractals numbered rows or more, left by a killed run
+     */
+    char name[600];
+    struct dirent *entry;
+    DIR *d = opendir(dir);
+    if (d == NULL) return;
+    while ((entry = readdir(d)) != NULL){
+        int fracnum, end = 0;
+        if (sscanf(entry -> d_name, "frac%d.png%n", &fracnum, &end) != 1 || end == 0) continue;
+        if (strcmp(entry -> d_name + end, ".tmp") == 0 || (entry -> d_name[end] == '\0' && fracnum >= rows)){
+            snprintf(name, sizeof(name), "%s/%s", dir, entry -> d_name);
+            if (remove(name) != 0) fprintf(stderr, "Failed to remove %s\n", name);
+        }
+    }
+    closedir(d);
+}
+
+static struct ShardWriter * nextshard(struct ShardWriter *w, const char *dir, int row, int shardsize,
+                                      int numfuncs, int width, int height, int imagetype){
+    /* This function returns the shard row is appended to. Shards start
+     * at multiples of shardsize, so the first row of a restarted run
+     * goes on the end of the shard the killed run was writing, if it
+     * is there
+     */
+    char name[300];
+    int first = row - row % shardsize;
+    if (w != NULL && row != first) return w;
+    if (w != NULL) shardclose(w);
+    if (first < row){
+        snprintf(name, sizeof(name), "%s/shard_%d.bin", dir, first);
+        if ((w = shardresume(name, numfuncs, width, height, imagetype, first, row - first)) != NULL) return w;
+    }
+    snprintf(name, sizeof(name), "%s/shard_%d.bin", dir, row);
+    return shardopen(name, numfuncs, width, height, imagetype, row);
+}
+
+static void writelevels(struct Pool *pool, struct Fractal *frac, struct Bitmap *levels, struct Slot *slot){
+    /* This function shrinks the picture of a fractal to each level of
+     * the pyramid, from the largest down so each is made from the
+     * smallest level it divides, and writes their pngs and records.
+     * Each level is swapped in as the fractal's picture to be written
+     */
+    char dir[300], fracname[340];
+    int l, k;
+    struct Bitmap full = frac -> bm;
+    for (l = 0; l < pool -> numlevels; l++){
+        const struct Bitmap *src = &full;
+        for (k = l - 1; k >= 0; k--){
+            if (levels[k].width % pool -> levelwidth[l] == 0){
+                src = &levels[k];
+                break;
+            }
+        }
+        bmreshape(&levels[l], pool -> levelwidth[l], pool -> levelheight[l], PIX_BIT, LAYOUT_ROWS);
+        bmshrink(&levels[l], src, src -> width / pool -> levelwidth[l]);
+        frac -> bm = levels[l];
+        if (pool -> writepng != 0){
+            snprintf(dir, sizeof(dir), "%s/%dx%d", pool -> dirname, pool -> levelwidth[l], pool -> levelheight[l]);
+            pngname(fracname, sizeof(fracname), dir, frac -> fracnum, 1);
+            WritePNG(fracname, frac);
+        }
+        if (pool -> shardsize > 0){
+            shardrecord(frac, SHARD_BITS, slot -> levelrecords[l], pool -> levelrecordsize[l]);
+        }
+    }
+    frac -> bm = full;
+}
+
+static void *worker(void *arg){
+    /* This function is run by each worker thread. It keeps claiming
+     * fractal numbers until all have been handed out. A worker only
+     * starts on fractal i once the slot it will write to has been
+     * committed, ie., once fractal i - numslots is in fracdata.dat,
+     * and sleeps on the slot until then
+     *
+     * Each worker draws all its fractals in the one fractal, so
+     * nothing is allocated per fractal (see remakefrac)
+     */
+    struct Pool *pool = (struct Pool *)arg;
+    char fracname[340];
+    int i;
+    struct Fractal *frac = NULL;
+    struct Bitmap levels[MAXLEVELS];
+    memset(levels, 0, sizeof(levels));
+    while ((i = atomic_fetch_add(&pool -> next, 1)) < pool -> numtogenerate){
+        struct Slot *slot = &pool -> slots[i % pool -> numslots];
+        pthread_mutex_lock(&slot -> lock);
+        while (slot -> turn != i) pthread_cond_wait(&slot -> change, &slot -> lock);
+        pthread_mutex_unlock(&slot -> lock);
+        if (frac == NULL) frac = makefrac(pool -> cfg, fracseed(pool -> masterseed, pool -> firstrow + i));
+        else remakefrac(frac, pool -> cfg, fracseed(pool -> masterseed, pool -> firstrow + i));
+        frac -> fracnum = pool -> firstrow + i;
+        if (frac -> converged == 0) unconverged(frac);
+        frac -> coloured = (pool -> cfg -> pixtype == PIX_U8) ? 0 : 1;
+        stddev(frac);
+        dimension(frac);
+        if (pool -> corrdim != 0) corrdimension(frac);
+        if (pool -> writepng != 0){
+            pngname(fracname, sizeof(fracname), pool -> dirname, frac -> fracnum, 1);
+            WritePNG(fracname, frac);
+        }
+        if (pool -> numlevels > 0) writelevels(pool, frac, levels, slot);
+        fracdataline(slot -> line, pool -> linesize, frac);
+        if (pool -> shardsize > 0){
+            shardrecord(frac, pool -> imagetype, slot -> record, pool -> recordsize);
+        }
+        pthread_mutex_lock(&slot -> lock);
+        slot -> ready = 1;
+        pthread_cond_broadcast(&slot -> change);
+        pthread_mutex_unlock(&slot -> lock);
+    }
+    if (frac != NULL) freefrac(frac);
+    for (i = 0; i < pool -> numlevels; i++) bmfree(&levels[i]);
+    return NULL;
+}
+
+static void usage(void){
+    fprintf(stderr, "Usage: generatedata [--job FILE] [--count N] [--dir DIR] [--points N] [--funcs N]\n"
+                    "       [--window MINX,MAXX,MINY,MAXY] [--no-cutoff] [--corrdim] [--threads N] [--seed MASTERSEED]\n"
+                    "       [--render SEED FILE] [--stream] [--autofit] [--simd] [--deterministic]\n"
+                    "       [--precision double|float]\n"
+                    "       [--adaptive] [--adapt-window K] [--adapt-rate R] [--min-points N]\n"
+                    "       [--resolution WIDTH HEIGHT] [--coloured] [--tiled] [--shards N] [--no-png]\n"
+                    "       [--density 16|32] [--tone log|gamma G] [--png-depth 8|16] [--supersample S]\n"
+                    "       [--pyramid W1,W2,...]\n"
+                    "       [--png-level 0-9] [--png-filter none|sub|up|avg|paeth|all] [--png-fast]\n");
+    exit(1);
+}
+
+static void readjob(char *filename, struct Options *opt);
+
+static void parseargs(int argc, char **argv, struct Options *opt){
+    /* This function sets the options in argv, which holds only options */
+    int i;
+    for (i = 0; i < argc; i++){
+        if (strcmp(argv[i], "--job") == 0 && i + 1 < argc){
+            readjob(argv[++i], opt);
+        }
+        else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc){
+            opt -> numtogenerate = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc){
+            snprintf(opt -> dirname, sizeof(opt -> dirname), "%s", argv[++i]);
+        }
+        else if (strcmp(argv[i], "--points") == 0 && i + 1 < argc){
+            opt -> numpoints = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--funcs") == 0 && i + 1 < argc){
+            opt -> numfuncs = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc){
+            double *w = opt -> cfg.window;
+            if (sscanf(argv[++i], "%lf,%lf,%lf,%lf", &w[0], &w[1], &w[2], &w[3]) != 4 || w[0] >= w[1] || w[2] >= w[3]){
+                fprintf(stderr, "The window should be MINX,MAXX,MINY,MAXY, eg. -8,8,-8,8\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--no-cutoff") == 0){
+            opt -> cfg.cutoff = 0;
+        }
+        else if (strcmp(argv[i], "--corrdim") == 0){
+            opt -> corrdim = 1;
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc){
+            opt -> numthreads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc){
+            opt -> masterseed = strtoull(argv[++i], NULL, 10);
+            opt -> seedgiven = 1;
+        }
+        else if (strcmp(argv[i], "--render") == 0 && i + 2 < argc){
+            opt -> renderseed = strtoull(argv[++i], NULL, 10);
+            opt -> renderfile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--stream") == 0){
+            opt -> cfg.stream = 1;
+        }
+        else if (strcmp(argv[i], "--adaptive") == 0){
+            opt -> cfg.stream = 1;
+            if (opt -> cfg.adaptwindow == 0) opt -> cfg.adaptwindow = 10000;
+        }
+        else if (strcmp(argv[i], "--adapt-window") == 0 && i + 1 < argc){
+            opt -> cfg.adaptwindow = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--adapt-rate") == 0 && i + 1 < argc){
+            opt -> cfg.adaptrate = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--min-points") == 0 && i + 1 < argc){
+            opt -> cfg.minpoints = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--autofit") == 0){
+            opt -> cfg.autofit = 1;
+        }
+        else if (strcmp(argv[i], "--simd") == 0){
+            opt -> cfg.engine = ENGINE_SIMD;
+        }
+        else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc){
+            i++;
+            if      (strcmp(argv[i], "double") == 0) opt -> cfg.precision = PREC_DOUBLE;
+            else if (strcmp(argv[i], "float")  == 0) opt -> cfg.precision = PREC_FLOAT;
+            else {
+                fprintf(stderr, "The precision is double or float\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--deterministic") == 0){
+            opt -> cfg.engine = ENGINE_IFS;
+        }
+        else if (strcmp(argv[i], "--resolution") == 0 && i + 2 < argc){
+            opt -> cfg.width  = atoi(argv[++i]);
+            opt -> cfg.height = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--coloured") == 0){
+            opt -> cfg.pixtype = PIX_U8;
+        }
+        else if (strcmp(argv[i], "--density") == 0 && i + 1 < argc){
+            i++;
+            if      (strcmp(argv[i], "16") == 0) opt -> cfg.pixtype = PIX_U16;
+            else if (strcmp(argv[i], "32") == 0) opt -> cfg.pixtype = PIX_U32;
+            else {
+                fprintf(stderr, "The density counts are either 16 or 32 bit\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--tone") == 0 && i + 1 < argc){
+            i++;
+            if (strcmp(argv[i], "log") == 0) opt -> tone = TONE_LOG;
+            else if (strcmp(argv[i], "gamma") == 0 && i + 1 < argc){
+                opt -> tone  = TONE_GAMMA;
+                opt -> gamma = atof(argv[++i]);
+            }
+            else {
+                fprintf(stderr, "The tone map is log or gamma G\n");
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--png-depth") == 0 && i + 1 < argc){
+            opt -> tonedepth = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--supersample") == 0 && i + 1 < argc){
+            opt -> cfg.supersample = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--pyramid") == 0 && i + 1 < argc){
+            char *word;
+            opt -> numlevels = 0;
+            for (word = strtok(argv[++i], ","); word != NULL; word = strtok(NULL, ",")){
+                if (opt -> numlevels == MAXLEVELS){
+                    fprintf(stderr, "The pyramid has at most %d levels\n", MAXLEVELS);
+                    exit(1);
+                }
+                opt -> levelwidth[opt -> numlevels++] = atoi(word);
+            }
+        }
+        else if (strcmp(argv[i], "--tiled") == 0){
+            opt -> cfg.layout = LAYOUT_TILES;
+        }
+        else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc){
+            opt -> shardsize = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--no-png") == 0){
+            opt -> writepng = 0;
+        }
+        else if (strcmp(argv[i], "--png-level") == 0 && i + 1 < argc){
+            opt -> pnglevel = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--png-filter") == 0 && i + 1 < argc){
+            i++;
+            if      (strcmp(argv[i], "none")  == 0) opt -> pngfilters = PNG_FILTER_NONE;
+            else if (strcmp(argv[i], "sub")   == 0) opt -> pngfilters = PNG_FILTER_SUB;
+            else if (strcmp(argv[i], "up")    == 0) opt -> pngfilters = PNG_FILTER_UP;
+            else if (strcmp(argv[i], "avg")   == 0) opt -> pngfilters = PNG_FILTER_AVG;
+            else if (strcmp(argv[i], "paeth") == 0) opt -> pngfilters = PNG_FILTER_PAETH;
+            else if (strcmp(argv[i], "all")   == 0) opt -> pngfilters = PNG_ALL_FILTERS;
+            else {
+                fprintf(stderr, "Unknown png filter %s (none, sub, up, avg, paeth or all)\n", argv[i]);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--png-fast") == 0){
+            opt -> pnglevel    = 1;
+            opt -> pngfilters  = PNG_FILTER_NONE;
+            opt -> pngstrategy = Z_RLE;
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            usage();
+        }
+    }
+}
+
+static void readjob(char *filename, struct Options *opt){
+    /* This function reads a job file. Every line is an option without
+     * its leading dashes followed by its values, and # starts a comment.
+     * The words are kept for the whole run, as --render keeps a pointer
+     */
+    char line[1024], *word;
+    char **args = NULL;
+    int numargs = 0, capacity = 0;
+    FILE *fp = fopen(filename, "r");
+    if (fp == NULL){
+        fprintf(stderr, "Failed to open file (readjob): %s\n", filename);
+        exit(1);
+    }
+    while (fgets(line, sizeof(line), fp) != NULL){
+        char *hash = strchr(line, '#');
+        if (hash != NULL) *hash = '\0';
+        int first = 1;
+        for (word = strtok(line, " \t\r\n"); word != NULL; word = strtok(NULL, " \t\r\n")){
+            if (numargs == capacity){
+                capacity = (capacity == 0) ? 16 : 2 * capacity;
+                if ((args = (char **)realloc(args, capacity * sizeof(char *))) == NULL){
+                    fprintf(stderr, "Malloc failed. (readjob)\n");
+                    exit(1);
+                }
+            }
+            if ((args[numargs] = (char *)malloc(strlen(word) + 3)) == NULL){
+                fprintf(stderr, "Malloc failed. (readjob)\n");
+                exit(1);
+            }
+            sprintf(args[numargs++], "%s%s", first ? "--" : "", word);
+            first = 0;
+        }
+    }
+    fclose(fp);
+    parseargs(numargs, args, opt);
+    free(args);
+}
 
 int main(int argc, char *argv[]){
-    int i, j, numpoints, numfuncs, numrows, numtogenerate;
-    int pcomp = 0; 
-    double window[4] = {-8,8,-8,8};
-    char dirname[50], fracname[50],filepath[100];
+    int i, numrows;
+    int pcomp = 0;
+    char filepath[300], idxpath[300];
+    char levelname[300];
+    struct ShardWriter *shard = NULL;
+    struct ShardWriter *levelshards[MAXLEVELS] = {NULL};
+    struct Manifest manifest;
+    struct Options opt;
+    int idxfd;
     FILE *fp;
-    srand(time(NULL));
-	
-    fprintf(stdout, "How many fractals would you like to generate: ");
-    scanf("%d", &numtogenerate);
-    fprintf(stdout, "\n");
-    
-    fprintf(stdout, "What is the directory called (Note: it should already be created): ");
-    scanf("%s", dirname);
-    
-    fprintf(stdout, "\nHow many points would you like to plot for each fractal: ");
-    scanf("%d", &numpoints);
-    
-    fprintf(stdout, "\nHow many functions in each IFS: ");
-    scanf("%d", &numfuncs);
-    
-    //fprintf(stdout, "\nEnter a vector representing the viewing window (eg. minx,maxx,miny,maxy): ");
-    //scanf("%s", tmp);	    
-    //dstrtovec(tmp, window, &tmpint);
-
-    sprintf(filepath, "./%s/fracdata.dat", dirname);
-
-    if ((fp = fopen(filepath, "r")) == NULL){
-        numrows = 0;
-    }
-    else {
-        numrows = lenfile(filepath);
+
+    memset(&opt, 0, sizeof(opt));
+    opt.numthreads    = 1;
+    opt.numtogenerate = -1;
+    opt.numpoints     = -1;
+    opt.numfuncs      = -1;
+    opt.writepng      = 1;
+    opt.masterseed    = (uint64_t)time(NULL);
+    opt.pnglevel      = Z_DEFAULT_COMPRESSION;
+    opt.pngfilters    = PNG_FILTER_NONE;
+    opt.pngstrategy   = Z_DEFAULT_STRATEGY;
+    opt.tone          = TONE_LOG;
+    opt.gamma         = 2.2;
+    opt.tonedepth     = 8;
+    defaultconfig(&opt.cfg, 0, 0);
+    opt.cfg.cutoff    = 1;
+    opt.cfg.adaptrate = 0.0005;
+    opt.cfg.minpoints = 20000;
+
+    parseargs(argc - 1, argv + 1, &opt);
+    struct FracConfig *cfg = &opt.cfg;
+    if (opt.numthreads < 1) opt.numthreads = 1;
+    setpngoptions(opt.pnglevel, opt.pngfilters, opt.pngstrategy);
+    settonemap(opt.tone, opt.gamma, opt.tonedepth);
+    if (cfg -> adaptwindow > 0 && cfg -> stream == 0){
+        fprintf(stderr, "The adaptive point budget needs --stream (or --adaptive)\n");
+        exit(1);
     }
-    if ((fp = fopen(filepath, "a")) == NULL){
-        fprintf(stderr, "Error, you must create the directory first\n");
+    if (cfg -> precision != PREC_DOUBLE){
+        if (cfg -> engine == ENGINE_IFS){
+            fprintf(stderr, "--precision can not be used with --deterministic\n");
+            exit(1);
+        }
+        cfg -> engine = ENGINE_SIMD;
+    }
+    if (cfg -> engine == ENGINE_IFS && cfg -> pixtype != PIX_BIT){
+        fprintf(stderr, "--deterministic can not be used with --coloured or --density\n");
+        exit(1);
+    }
+    if (cfg -> supersample > 1 && cfg -> pixtype != PIX_BIT){
+        fprintf(stderr, "--supersample can not be used with --coloured or --density\n");
+        exit(1);
+    }
+    if (cfg -> width < 8 || cfg -> height < 8){
+        fprintf(stderr, "The resolution must be at least 8 x 8\n");
         exit(1);
     }
+    if (opt.numlevels > 0 && (cfg -> pixtype != PIX_BIT || cfg -> supersample > 1)){
+        fprintf(stderr, "--pyramid can not be used with --coloured, --density or --supersample\n");
+        exit(1);
+    }
+    for (i = 0; i < opt.numlevels; i++){
+        /* Sort the levels largest first and check each one divides the picture */
+        int j, w = opt.levelwidth[i];
+        for (j = i + 1; j < opt.numlevels; j++){
+            if (opt.levelwidth[j] > w){
+                opt.levelwidth[i] = opt.levelwidth[j];
+                opt.levelwidth[j] = w;
+                w = opt.levelwidth[i];
+            }
+        }
+        if (w < 8 || w >= cfg -> width || cfg -> width % w != 0 || cfg -> height % (cfg -> width / w) != 0
+            || cfg -> height / (cfg -> width / w) < 8 || (i > 0 && w == opt.levelwidth[i - 1])){
+            fprintf(stderr, "The pyramid widths must be different, at least 8 and divide the %d x %d picture\n",
+                    cfg -> width, cfg -> height);
+            exit(1);
+        }
+    }
+
+    if (opt.renderfile == NULL){
+        if (opt.numtogenerate < 0){
+            fprintf(stdout, "How many fractals would you like to generate: ");
+            scanf("%d", &opt.numtogenerate);
+            fprintf(stdout, "\n");
+        }
+        if (opt.dirname[0] == '\0'){
+            fprintf(stdout, "What is the directory called (Note: it should already be created): ");
+            scanf("%255s", opt.dirname);
+            fprintf(stdout, "\n");
+        }
+    }
+    if (opt.numpoints < 0){
+        fprintf(stdout, "How many points would you like to plot for each fractal: ");
+        scanf("%d", &opt.numpoints);
+        fprintf(stdout, "\n");
+    }
+    if (opt.numfuncs < 0){
+        fprintf(stdout, "How many functions in each IFS: ");
+        scanf("%d", &opt.numfuncs);
+        fprintf(stdout, "\n");
+    }
+    if (opt.numfuncs < 1 || opt.numpoints < 1){
+        fprintf(stderr, "The number of points and of functions must be positive\n");
+        exit(1);
+    }
+    cfg -> numfuncs  = opt.numfuncs;
+    cfg -> numpoints = opt.numpoints;
 
-    fprintf(stdout, "Generating fractals %d to %d\n", numrows, numrows+numtogenerate);
-    for (i = 0; i < numtogenerate; i++){
-    	struct Fractal *frac = makerandfrac(numpoints, numfuncs, window, 1);
+    if (opt.renderfile != NULL){
+        /* Regenerate a single fractal from the seed in its data line */
+        char *line;
+        struct Fractal *frac = makefrac(cfg, opt.renderseed);
+        if (frac -> converged == 0) unconverged(frac);
+        frac -> coloured = (cfg -> pixtype == PIX_U8) ? 0 : 1;
         stddev(frac);
         dimension(frac);
-        /* fractal number, numfuncs, numpoints, numb, avgx, avgy, stddevx, stddevy, dimension, genome */
-        fprintf(fp, "%d\t%d\t%d\t%d\t%d\t%d\t%.15lf\t%.15lf\t%.15lf\t", numrows+i, frac->numfuncs, frac->numpoints, frac->numb, frac->avgx, frac->avgy, frac->stddevx, frac->stddevy, frac -> dimension);
-        for (j = 0; j < 4 * frac -> numfuncs; j++){
-	    fprintf(fp, "%.15lf\t", frac -> genome[0][j]);
+        if (opt.corrdim != 0) corrdimension(frac);
+        WritePNG(opt.renderfile, frac);
+        if ((line = (char *)malloc(LINESIZE(opt.numfuncs))) == NULL){
+            fprintf(stderr, "Malloc failed. (main)\n");
+            exit(1);
         }
-        for (j = 0; j < 2 * frac -> numfuncs; j++){
-            fprintf(fp, "%.15lf\t", frac -> genome[1][j]);
+        fracdataline(line, LINESIZE(opt.numfuncs), frac);
+        fputs(line, stdout);
+        free(line);
+        freefrac(frac);
+        exit(0);
+    }
+
+    snprintf(filepath, sizeof(filepath), "%s/fracdata.dat", opt.dirname);
+    snprintf(idxpath, sizeof(idxpath), "%s/fracdata.idx", opt.dirname);
+
+    if (resumedata(filepath, idxpath, &manifest) != 0 && manifest.rows > 0 && opt.seedgiven == 0){
+        /* Carry on with the master seed of the run being resumed */
+        opt.masterseed = manifest.masterseed;
+    }
+    numrows = (int)manifest.rows;
+    removeorphans(opt.dirname, numrows);
+    if ((fp = fopen(filepath, "a")) == NULL){
+        fprintf(stderr, "Error, you must create the directory first\n");
+        exit(1);
+    }
+    for (i = 0; i < opt.numlevels; i++){
+        snprintf(levelname, sizeof(levelname), "%s/%dx%d", opt.dirname, opt.levelwidth[i],
+                 cfg -> height / (cfg -> width / opt.levelwidth[i]));
+        if (mkdir(levelname, 0777) != 0 && errno != EEXIST){
+            fprintf(stderr, "Failed to create directory %s\n", levelname);
+            exit(1);
         }
-	for (j = 0; j < frac -> numfuncs; j++){
-            fprintf(fp, "%.15lf\t", frac -> genome[2][j]);
+        removeorphans(levelname, numrows);
+    }
+    idxfd = openmanifest(idxpath);
+    manifest.masterseed = opt.masterseed;
+    writemanifest(idxfd, &manifest);
+
+    struct Pool pool;
+    pool.numtogenerate = opt.numtogenerate;
+    pool.firstrow      = numrows;
+    pool.numslots      = SLOTSPERTHREAD * opt.numthreads;
+    pool.masterseed    = opt.masterseed;
+    pool.linesize      = LINESIZE(opt.numfuncs);
+    pool.cfg           = cfg;
+    pool.dirname       = opt.dirname;
+    pool.shardsize     = opt.shardsize;
+    pool.writepng      = opt.writepng;
+    pool.corrdim       = opt.corrdim;
+    pool.imagetype     = (cfg -> pixtype == PIX_BIT && cfg -> supersample <= 1) ? SHARD_BITS : SHARD_U8;
+    pool.recordsize    = shardrecordsize(opt.numfuncs, cfg -> width, cfg -> height, pool.imagetype);
+    pool.numlevels     = opt.numlevels;
+    for (i = 0; i < opt.numlevels; i++){
+        pool.levelwidth[i]      = opt.levelwidth[i];
+        pool.levelheight[i]     = cfg -> height / (cfg -> width / opt.levelwidth[i]);
+        pool.levelrecordsize[i] = shardrecordsize(opt.numfuncs, pool.levelwidth[i], pool.levelheight[i], SHARD_BITS);
+    }
+    atomic_init(&pool.next, 0);
+    if ((pool.slots = (struct Slot *)malloc(pool.numslots * sizeof(struct Slot))) == NULL){
+        fprintf(stderr, "Malloc failed. (generatedata)\n");
+        exit(1);
+    }
+    for (i = 0; i < pool.numslots; i++){
+        pthread_mutex_init(&pool.slots[i].lock, NULL);
+        pthread_cond_init(&pool.slots[i].change, NULL);
+        pool.slots[i].turn  = i;
+        pool.slots[i].ready = 0;
+        pool.slots[i].record = NULL;
+        if (opt.shardsize > 0 && (pool.slots[i].record = (unsigned char *)malloc(pool.recordsize)) == NULL){
+            fprintf(stderr, "Malloc failed. (generatedata)\n");
+            exit(1);
         }
-        for (j = 0; j < frac -> numfuncs-1; j++){
-            fprintf(fp, "%.15lf\t", frac -> genome[3][j]);
+        for (int l = 0; l < MAXLEVELS; l++){
+            pool.slots[i].levelrecords[l] = NULL;
+            if (l < opt.numlevels && opt.shardsize > 0
+                && (pool.slots[i].levelrecords[l] = (unsigned char *)malloc(pool.levelrecordsize[l])) == NULL){
+                fprintf(stderr, "Malloc failed. (generatedata)\n");
+                exit(1);
+            }
+        }
+        if ((pool.slots[i].line = (char *)malloc(pool.linesize)) == NULL){
+            fprintf(stderr, "Malloc failed. (generatedata)\n");
+            exit(1);
+        }
+    }
+    pthread_t *threads;
+    if ((threads = (pthread_t *)malloc(opt.numthreads * sizeof(pthread_t))) == NULL){
+        fprintf(stderr, "Malloc failed. (generatedata)\n");
+        exit(1);
+    }
+    for (i = 0; i < opt.numthreads; i++){
+        if (pthread_create(&threads[i], NULL, worker, &pool) != 0){
+            fprintf(stderr, "Failed to create worker thread %d\n", i);
+            exit(1);
         }
-        fprintf(fp, "%.15lf\n", frac -> genome[3][frac -> numfuncs -1]);
-        sprintf(fracname, "%s/frac%d.png", dirname, numrows+i);
-        WritePNG(fracname, frac);
-    	freefrac(frac);
-        if (numtogenerate >= 100 && (i%((int)(numtogenerate/100.)) == 0)){
+    }
+
+    fprintf(stdout, "Generating fractals %d to %d (master seed %llu)\n", numrows, numrows+opt.numtogenerate, (unsigned long long)opt.masterseed);
+    for (i = 0; i < opt.numtogenerate; i++){
+        /* Commit the fractals in order as they are finished. The pngs
+         * and shard records go in first, and the line is flushed
+         * before the manifest counts it
+         */
+        struct Slot *slot = &pool.slots[i % pool.numslots];
+        int row = numrows + i;
+        pthread_mutex_lock(&slot -> lock);
+        while (slot -> ready == 0) pthread_cond_wait(&slot -> change, &slot -> lock);
+        pthread_mutex_unlock(&slot -> lock);
+        if (opt.writepng != 0){
+            commitpng(opt.dirname, row);
+            for (int l = 0; l < opt.numlevels; l++){
+                snprintf(levelname, sizeof(levelname), "%s/%dx%d", opt.dirname, pool.levelwidth[l], pool.levelheight[l]);
+                commitpng(levelname, row);
+            }
+        }
+        if (opt.shardsize > 0){
+            shard = nextshard(shard, opt.dirname, row, opt.shardsize, opt.numfuncs, cfg -> width, cfg -> height,
+                              pool.imagetype);
+            shardappend(shard, slot -> record);
+            for (int l = 0; l < opt.numlevels; l++){
+                snprintf(levelname, sizeof(levelname), "%s/%dx%d", opt.dirname, pool.levelwidth[l], pool.levelheight[l]);
+                levelshards[l] = nextshard(levelshards[l], levelname, row, opt.shardsize, opt.numfuncs,
+                                           pool.levelwidth[l], pool.levelheight[l], SHARD_BITS);
+                shardappend(levelshards[l], slot -> levelrecords[l]);
+            }
+        }
+        fputs(slot -> line, fp);
+        fflush(fp);
+        manifest.rows  += 1;
+        manifest.bytes += strlen(slot -> line);
+        writemanifest(idxfd, &manifest);
+        pthread_mutex_lock(&slot -> lock);
+        slot -> ready = 0;
+        slot -> turn  = i + pool.numslots; //hand the slot on
+        pthread_cond_broadcast(&slot -> change);
+        pthread_mutex_unlock(&slot -> lock);
+        if (opt.numtogenerate >= 100 && (i%((int)(opt.numtogenerate/100.)) == 0)){
             pcomp += 1;
             if (pcomp < 10){
                 fprintf(stdout, "\rPercent Complete:\t%d%%", pcomp);
@@ -91,7 +834,24 @@ int main(int argc, char *argv[]){
             fflush(stdout);
         }
     }
-    fprintf(stdout, "\n"); 
+    for (i = 0; i < opt.numthreads; i++){
+        pthread_join(threads[i], NULL);
+    }
+    fprintf(stdout, "\n");
     fclose(fp);
+    close(idxfd);
+    if (shard != NULL) shardclose(shard);
+    for (i = 0; i < opt.numlevels; i++){
+        if (levelshards[i] != NULL) shardclose(levelshards[i]);
+    }
+    for (i = 0; i < pool.numslots; i++){
+        free(pool.slots[i].line);
+        free(pool.slots[i].record);
+        for (int l = 0; l < opt.numlevels; l++) free(pool.slots[i].levelrecords[l]);
+        pthread_mutex_destroy(&pool.slots[i].lock);
+        pthread_cond_destroy(&pool.slots[i].change);
+    }
+    free(pool.slots);
+    free(threads);
     exit(0);
 }
@@ -0,0 +1,102 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: genomes.c
+ *
+ * This file contains the parts of genome generation that have
+ * their own kernels: the contractivity test and the ordering of
+ * the functions.
+ */
+
+#include <math.h>
+#include "genomes.h"
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+static void contractivescalar(const double *a, const double *b, const double *c, const double *d,
+                              double *specrad, int n){
+    /* This function finds the spectral radius of n matrices
+     * [a b; c d], or 0 for the ones that are not contractive or
+     * have complex eigenvalues, as validatefunc does for one. The
+     * eigenvalues are (Tr +- sqrt(Tr^2 - 4 det))/2, so the larger
+     * one in size is (|Tr| + sqrt(Tr^2 - 4 det))/2 and one square
+     * root is enough
+     */
+    for (int j = 0; j < n; j++){
+        double tr = a[j] + d[j];
+        double det = a[j] * d[j] - b[j] * c[j];
+        double discr = tr * tr - 4 * det;
+        double r = (fabs(tr) + sqrt(discr < 0 ? 0 : discr)) * 0.5;
+        specrad[j] = (discr >= 0 && r < 1) ? r : 0;
+    }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2")))
+static void contractiveavx2(const double *a, const double *b, const double *c, const double *d,
+                            double *specrad, int n){
+    /* AVX2 version of contractivescalar, four matrices at a time. The
+     * tests become masks, so there are no branches and no errno, and
+     * every result is the one contractivescalar gives
+     */
+    const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd(1.0);
+    const __m256d four = _mm256_set1_pd(4.0), half = _mm256_set1_pd(0.5);
+    const __m256d sign = _mm256_set1_pd(-0.0);
+    int j;
+    for (j = 0; j + 4 <= n; j += 4){
+        __m256d va = _mm256_loadu_pd(a + j), vd = _mm256_loadu_pd(d + j);
+        __m256d tr = _mm256_add_pd(va, vd);
+        __m256d det = _mm256_sub_pd(_mm256_mul_pd(va, vd), _mm256_mul_pd(_mm256_loadu_pd(b + j), _mm256_loadu_pd(c + j)));
+        __m256d discr = _mm256_sub_pd(_mm256_mul_pd(tr, tr), _mm256_mul_pd(four, det));
+        __m256d real = _mm256_cmp_pd(discr, zero, _CMP_GE_OQ);
+        __m256d root = _mm256_sqrt_pd(_mm256_and_pd(real, discr));
+        __m256d r = _mm256_mul_pd(_mm256_add_pd(_mm256_andnot_pd(sign, tr), root), half);
+        __m256d keep = _mm256_and_pd(real, _mm256_cmp_pd(r, one, _CMP_LT_OQ));
+        _mm256_storeu_pd(specrad + j, _mm256_and_pd(keep, r));
+    }
+    contractivescalar(a + j, b + j, c + j, d + j, specrad + j, n - j);
+}
+#endif
+
+void contractive(const double *a, const double *b, const double *c, const double *d, double *specrad, int n){
+    /* This function finds the spectral radii of n matrices, see
+     * contractivescalar, with AVX2 if the cpu has it
+     */
+#if defined(__x86_64__)
+    static int avx2 = -1;
+    if (avx2 < 0){
+        __builtin_cpu_init();
+        avx2 = __builtin_cpu_supports("avx2") != 0;
+    }
+    if (avx2){
+        contractiveavx2(a, b, c, d, specrad, n);
+        return;
+    }
+#endif
+    contractivescalar(a, b, c, d, specrad, n);
+}
+
+void sortgenome(int numfuncs, double *mults, double *adds, double *probs, double *specrads){
+    /* This function orders the functions of a genome from the
+     * smallest spectral radius to the largest, in place. It is an
+     * odd-even transposition network, which only swaps neighbours
+     * that are strictly out of order, so functions with equal radii
+     * keep their order as they did with dsortmatrows
+     */
+    int r, i, j;
+    double t;
+    for (r = 0; r < numfuncs; r++){
+        for (i = r & 1; i + 1 < numfuncs; i += 2){
+            if (!(specrads[i] > specrads[i+1])) continue;
+            t = specrads[i]; specrads[i] = specrads[i+1]; specrads[i+1] = t;
+            t = probs[i];    probs[i]    = probs[i+1];    probs[i+1]    = t;
+            for (j = 0; j < 4; j++){
+                t = mults[4*i+j]; mults[4*i+j] = mults[4*i+4+j]; mults[4*i+4+j] = t;
+            }
+            for (j = 0; j < 2; j++){
+                t = adds[2*i+j]; adds[2*i+j] = adds[2*i+2+j]; adds[2*i+2+j] = t;
+            }
+        }
+    }
+}
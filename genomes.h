@@ -0,0 +1,17 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: genomes.h
+ *
+ * The kernels generategenome uses: the contractivity test of a
+ * run of matrices, whose parameters are each in their own array,
+ * and the ordering of the functions of a genome laid out as in
+ * struct Fractal (genome[0] to genome[3]).
+ */
+#ifndef GENOMES_H
+#define GENOMES_H
+
+void contractive(const double *a, const double *b, const double *c, const double *d, double *specrad, int n);
+void sortgenome(int numfuncs, double *mults, double *adds, double *probs, double *specrads);
+
+#endif
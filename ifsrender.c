@@ -0,0 +1,517 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: ifsrender.c
+ *
+ * This file contains the deterministic renderer. The chaos game
+ * draws a pixel if one of its points lands on it, which it does with
+ * probability 1 - exp(-N mu) for N points and mu the share of the
+ * attractor's invariant measure on the pixel. generateifs works mu
+ * out without random numbers and draws the pixels where that
+ * probability is at least a half, N mu >= ln 2, so a genome always
+ * gives the same picture, one a chaos game of numpoints points would
+ * be expected to draw (checkprecision --deterministic compares them).
+ *
+ * The attractor is found on a grid of IFSSUB x IFSSUB cells per
+ * pixel: from the fixed points of the functions, which lie on it,
+ * the point kept for each cell reached is mapped through every
+ * function until no new cell is reached, noting which cell each
+ * function takes each cell to. The measure is then pushed along
+ * those moves, weighted by the probabilities of the functions,
+ * until it stops changing (at most IFSMAXROUNDS rounds).
+ *
+ * ifsimage applies the functions to any bit map once, which is what
+ * the collage distance needs (see collage.c).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "Fractals.h"
+#include "ifsrender.h"
+
+#define IFSSUB 2     //cells of the grid per pixel, in x and in y
+#define IFSMARGIN 1  //window widths followed outside the window on each side
+#define IFSBATCH 256 //pixels drawn at a time
+#define IFSMAXROUNDS 1000  //rounds the measure gets to settle in
+#define IFSTOLERANCE 0.01  //the change it settles to, relative to a pixel's threshold
+#define IFSIMAGEFUNCS 16  //functions ifsimage has room for without a malloc
+
+struct Canvas{
+    /* The state of one ifsimage: the functions in pixel space,
+     * the bit map being drawn into and the extent of the images */
+    double *m;            //a, b, c, d, e, f of each function in pixel space
+    int numfuncs, width, height, words;
+    uint64_t *next;       //the pixels drawn this round
+    int lo, hi;           //the rows of next that may be set
+    double ext[4];        //minx, maxx, miny, maxy of the images, in pixels
+};
+
+struct Search{
+    /* The state of one render by generateifs */
+    int width, height;
+    double mx, my;           //the margin around the window, in pixels
+    long gridwidth, gridheight;
+    int32_t *inside;         //the number + 1 of each cell inside the window reached
+    uint64_t *keys;          //and a hash table from the cells outside it
+    int32_t *cells;          //to their numbers, in the order they were reached
+    size_t tablesize;        //a power of 2
+    double *points;          //the point reached in each cell, x and y
+    size_t numcells, capacity;
+    double ext[4];           //minx, maxx, miny, maxy of the points, in pixels
+    int outside;             //set once a point outside the window is reached
+};
+
+/* The scratch of generateifs, kept per thread between renders */
+static __thread int32_t *inside = NULL;
+static __thread size_t insidecap = 0;
+static __thread uint64_t *keys = NULL;
+static __thread int32_t *cells = NULL;
+static __thread size_t tablesize = 0;
+static __thread double *points = NULL;
+static __thread size_t capacity = 0;
+static __thread int32_t *targets = NULL;
+static __thread size_t targetcap = 0;
+static __thread double *mass = NULL, *nextmass = NULL;
+static __thread size_t masscap = 0;
+static __thread double *pixmass = NULL;
+static __thread size_t pixmasscap = 0;
+
+static void pixelmaps(const double *mults, const double *adds, int numfuncs, const double *window,
+                      int width, int height, double *m){
+    /* This function writes each function of a genome as it acts
+     * on pixel coordinates, where pixel (x,y) covers [x,x+1)x[y,y+1)
+     * and y runs down the image as in pointtocoord
+     */
+    double sx = width/(window[1] - window[0]);
+    double sy = height/(window[3] - window[2]);
+    for (int i = 0; i < numfuncs; i++){
+        double a = mults[4*i+0], b = mults[4*i+1];
+        double c = mults[4*i+2], d = mults[4*i+3];
+        double e = adds[2*i+0], f = adds[2*i+1];
+        m[6*i+0] =  a;
+        m[6*i+1] = -b * sx/sy;
+        m[6*i+2] = -c * sy/sx;
+        m[6*i+3] =  d;
+        m[6*i+4] = sx * (a * window[0] + b * window[3] + e - window[0]);
+        m[6*i+5] = sy * (window[3] - c * window[0] - d * window[3] - f);
+    }
+}
+
+static inline void setrun(uint64_t *row, int x0, int x1){
+    /* This function sets bits x0 to x1 (inclusive) of a row */
+    int j0 = x0 >> 6, j1 = x1 >> 6;
+    uint64_t m0 = ~0ULL << (x0 & 63);
+    uint64_t m1 = ~0ULL >> (63 - (x1 & 63));
+    if (j0 == j1){
+        row[j0] |= m0 & m1;
+        return;
+    }
+    row[j0] |= m0;
+    for (int j = j0 + 1; j < j1; j++) row[j] = ~0ULL;
+    row[j1] |= m1;
+}
+
+static void drawsegment(struct Canvas *cv, double px, double py, double qx, double qy){
+    /* This function draws the segment from (px,py) to (qx,qy) into
+     * next. Parts outside the image are dropped, not clamped to the
+     * edge as in stamppoints (see ifsrender.h), but still count
+     * towards the extent, and pixels on row or column 0 go to 1 as
+     * in stamppoints
+     */
+    double t;
+    int r, r0, r1;
+    if (px < cv -> ext[0]) cv -> ext[0] = px;
+    if (px > cv -> ext[1]) cv -> ext[1] = px;
+    if (qx < cv -> ext[0]) cv -> ext[0] = qx;
+    if (qx > cv -> ext[1]) cv -> ext[1] = qx;
+    if (py > qy){
+        t = px; px = qx; qx = t;
+        t = py; py = qy; qy = t;
+    }
+    if (py < cv -> ext[2]) cv -> ext[2] = py;
+    if (qy > cv -> ext[3]) cv -> ext[3] = qy;
+    if (qy < 0 || py >= cv -> height) return;
+    r0 = (py < 0) ? 0 : (int)py;
+    r1 = (qy >= cv -> height) ? cv -> height - 1 : (int)qy;
+    double slope = (qy > py) ? (qx - px)/(qy - py) : 0;
+    for (r = r0; r <= r1; r++){
+        double xa = px, xb = qx;
+        if (qy > py){
+            xa = px + ((py > r ? py : r) - py) * slope;
+            xb = px + ((qy < r + 1 ? qy : r + 1) - py) * slope;
+        }
+        if (xa > xb){
+            t = xa; xa = xb; xb = t;
+        }
+        if (xb < 0 || xa >= cv -> width) continue;
+        int x0 = (xa < 1) ? 1 : (int)xa;
+        int x1 = (xb >= cv -> width - 1) ? cv -> width - 1 : (int)xb;
+        int row = (r < 1) ? 1 : r;
+        if (x1 < x0) x1 = x0;
+        setrun(cv -> next + (size_t)row * cv -> words, x0, x1);
+        if (row < cv -> lo) cv -> lo = row;
+        if (row > cv -> hi) cv -> hi = row;
+    }
+}
+
+static int nextrun(const uint64_t *row, int words, int x, int *x0, int *x1){
+    /* This function finds the first run of set bits of a row at or
+     * after bit x. It returns 0 if there is none, otherwise the run
+     * is bits *x0 to *x1 - 1
+     */
+    int j = x >> 6;
+    uint64_t w;
+    if (j >= words) return 0;
+    w = row[j] & (~0ULL << (x & 63));
+    while (w == 0){
+        if (++j >= words) return 0;
+        w = row[j];
+    }
+    *x0 = 64*j + __builtin_ctzll(w);
+    w = ~row[j] & (~0ULL << (*x0 & 63));
+    while (w == 0){
+        if (++j >= words){
+            *x1 = 64*words;
+            return 1;
+        }
+        w = ~row[j];
+    }
+    *x1 = 64*j + __builtin_ctzll(w);
+    return 1;
+}
+
+static void *growscratch(void *p, size_t *have, size_t need, size_t size){
+    /* This function makes room for need elements of size bytes in a
+     * scratch buffer holding *have, keeping its contents
+     */
+    if (*have >= need) return p;
+    if (need < 2 * *have) need = 2 * *have;
+    if ((p = realloc(p, need * size)) == NULL){
+        fprintf(stderr, "Malloc failed. (generateifs)\n");
+        exit(1);
+    }
+    *have = need;
+    return p;
+}
+
+static inline size_t cellhash(uint64_t key, size_t tablesize){
+    return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (tablesize - 1);
+}
+
+static void growtable(struct Search *sr){
+    /* This function doubles the hash table of the cells reached */
+    size_t i, h, size = 2 * sr -> tablesize;
+    uint64_t *k;
+    int32_t *c;
+    if ((k = (uint64_t *)calloc(size, sizeof(uint64_t))) == NULL ||
+        (c = (int32_t *)malloc(size * sizeof(int32_t))) == NULL){
+        fprintf(stderr, "Malloc failed. (generateifs)\n");
+        exit(1);
+    }
+    for (i = 0; i < sr -> tablesize; i++){
+        if (sr -> keys[i] == 0) continue;
+        for (h = cellhash(sr -> keys[i], size); k[h] != 0; h = (h + 1) & (size - 1));
+        k[h] = sr -> keys[i];
+        c[h] = sr -> cells[i];
+    }
+    free(sr -> keys);
+    free(sr -> cells);
+    sr -> keys = k;
+    sr -> cells = c;
+    sr -> tablesize = size;
+}
+
+static int32_t newcell(struct Search *sr, double x, double y){
+    /* This function gives the next number to a cell with point (x,y) */
+    sr -> points = (double *)growscratch(sr -> points, &sr -> capacity, 2 * (sr -> numcells + 1), sizeof(double));
+    sr -> points[2 * sr -> numcells]     = x;
+    sr -> points[2 * sr -> numcells + 1] = y;
+    return (int32_t)(sr -> numcells++);
+}
+
+static int32_t visit(struct Search *sr, double x, double y){
+    /* This function records that the attractor point (x,y), in pixel
+     * coordinates, has been reached, and returns the number of its
+     * cell of the grid, or -1 if it is too far outside the window to
+     * follow. A cell not reached before gets the next number and
+     * keeps (x,y) as its point
+     */
+    long gx, gy;
+    uint64_t key;
+    size_t h;
+    int32_t *in;
+    if (x < sr -> ext[0]) sr -> ext[0] = x;
+    if (x > sr -> ext[1]) sr -> ext[1] = x;
+    if (y < sr -> ext[2]) sr -> ext[2] = y;
+    if (y > sr -> ext[3]) sr -> ext[3] = y;
+    if (!(x > 0 && x < sr -> width && y > 0 && y < sr -> height)) sr -> outside = 1;
+    if (x >= 0 && x < sr -> width && y >= 0 && y < sr -> height){
+        in = sr -> inside + (size_t)(y * IFSSUB) * sr -> width * IFSSUB + (size_t)(x * IFSSUB);
+        if (*in == 0){
+            if (sr -> numcells > 2147483646UL) return -1;
+            *in = newcell(sr, x, y) + 1;
+        }
+        return *in - 1;
+    }
+    if (!(x >= -sr -> mx && x < sr -> width + sr -> mx && y >= -sr -> my && y < sr -> height + sr -> my)) return -1;
+    gx = (long)((x + sr -> mx) * IFSSUB);
+    gy = (long)((y + sr -> my) * IFSSUB);
+    if (gx >= sr -> gridwidth || gy >= sr -> gridheight) return -1;
+    key = (uint64_t)gy * sr -> gridwidth + gx + 1; //0 marks an empty slot
+    for (h = cellhash(key, sr -> tablesize); sr -> keys[h] != 0; h = (h + 1) & (sr -> tablesize - 1)){
+        if (sr -> keys[h] == key) return sr -> cells[h];
+    }
+    if (sr -> numcells > 2147483646UL) return -1;
+    sr -> keys[h] = key;
+    sr -> cells[h] = newcell(sr, x, y);
+    if (2 * sr -> numcells > sr -> tablesize) growtable(sr);
+    return sr -> cells[h];
+}
+
+static void search(struct Search *sr, struct Fractal *frac, const double *window, double *m, int stopoutside){
+    /* This function finds the cells of the grid the attractor of a
+     * fractal reaches, in the pixel space of window, by mapping
+     * points of it through every function from the fixed points on,
+     * and notes in targets which cell each function takes each cell
+     * to. m gets the functions in pixel space. If stopoutside is set
+     * it stops at the first point outside the window
+     */
+    struct Bitmap *bm = (frac -> supersample > 1) ? &frac -> ssbm : &frac -> bm;
+    size_t head;
+    int i, n = frac -> numfuncs;
+    sr -> width      = bm -> width;
+    sr -> height     = bm -> height;
+    sr -> mx         = IFSMARGIN * bm -> width;
+    sr -> my         = IFSMARGIN * bm -> height;
+    sr -> gridwidth  = (long)(2*IFSMARGIN + 1) * bm -> width * IFSSUB;
+    sr -> gridheight = (long)(2*IFSMARGIN + 1) * bm -> height * IFSSUB;
+    if (tablesize == 0){
+        tablesize = 1 << 16;
+        if ((keys = (uint64_t *)malloc(tablesize * sizeof(uint64_t))) == NULL ||
+            (cells = (int32_t *)malloc(tablesize * sizeof(int32_t))) == NULL){
+            fprintf(stderr, "Malloc failed. (generateifs)\n");
+            exit(1);
+        }
+    }
+    head = insidecap;
+    inside = (int32_t *)growscratch(inside, &insidecap, (size_t)sr -> width * sr -> height * IFSSUB * IFSSUB, sizeof(int32_t));
+    if (insidecap != head) memset(inside, 0, insidecap * sizeof(int32_t)); //kept zeroed between searches
+    memset(keys, 0, tablesize * sizeof(uint64_t));
+    sr -> inside    = inside;
+    sr -> keys      = keys;
+    sr -> cells     = cells;
+    sr -> tablesize = tablesize;
+    sr -> points    = points;
+    sr -> capacity  = capacity;
+    sr -> numcells  = 0;
+    sr -> outside   = 0;
+    pixelmaps(frac -> genome[0], frac -> genome[1], n, window, sr -> width, sr -> height, m);
+
+    /* The fixed point of x -> Mx + t is (I - M)^-1 t */
+    for (i = 0; i < n; i++){
+        double *f = m + 6*i;
+        double det = (1 - f[0]) * (1 - f[3]) - f[1] * f[2];
+        double fx = ((1 - f[3]) * f[4] + f[1] * f[5])/det;
+        double fy = (f[2] * f[4] + (1 - f[0]) * f[5])/det;
+        if (i == 0){
+            sr -> ext[0] = sr -> ext[1] = fx;
+            sr -> ext[2] = sr -> ext[3] = fy;
+        }
+        visit(sr, fx, fy);
+    }
+
+    /* The cells only grow while new ones are reached, so this
+     * always finishes */
+    for (head = 0; head < sr -> numcells && !(stopoutside && sr -> outside); head++){
+        double x = sr -> points[2*head], y = sr -> points[2*head + 1];
+        targets = (int32_t *)growscratch(targets, &targetcap, n * (head + 1), sizeof(int32_t));
+        for (i = 0; i < n; i++){
+            double *f = m + 6*i;
+            targets[n*head + i] = visit(sr, f[0] * x + f[1] * y + f[4], f[2] * x + f[3] * y + f[5]);
+        }
+    }
+    for (head = 0; head < sr -> numcells; head++){
+        double x = sr -> points[2*head], y = sr -> points[2*head + 1];
+        if (x >= 0 && x < sr -> width && y >= 0 && y < sr -> height){
+            inside[(size_t)(y * IFSSUB) * sr -> width * IFSSUB + (size_t)(x * IFSSUB)] = 0;
+        }
+    }
+    keys      = sr -> keys;
+    cells     = sr -> cells;
+    tablesize = sr -> tablesize;
+    points    = sr -> points;
+    capacity  = sr -> capacity;
+}
+
+int ifsinside(struct Fractal *frac, double *window){
+    /* This function returns 1 if the attractor of a fractal lies
+     * inside the window, as insidewindow does for the extrema of
+     * generateifs, stopping as soon as it finds a point outside.
+     * makefrac uses it to reject genomes for the cutoff before
+     * generateifs works out their measure
+     */
+    struct Search sr;
+    double *m;
+    if ((m = (double *)malloc(6 * frac -> numfuncs * sizeof(double))) == NULL){
+        fprintf(stderr, "Malloc failed. (ifsinside)\n");
+        exit(1);
+    }
+    search(&sr, frac, window, m, 1);
+    free(m);
+    return !sr.outside;
+}
+
+void generateifs(struct Fractal *frac, double *window, double *extrema){
+    /* This function draws a fractal from the invariant measure of its
+     * IFS, see the comment at the top. The extrema are those of the
+     * points reached, including the ones outside the window, so the
+     * cutoff and autofit checks of makefrac work as they do for the
+     * chaos game. pointsused is set to the number of points mapped,
+     * and frac -> converged to 0 if the measure had not settled after
+     * IFSMAXROUNDS rounds.
+     */
+    struct Search sr;
+    int pixx[IFSBATCH], pixy[IFSBATCH], colours[IFSBATCH], pixels = 0;
+    double *m, *p = frac -> genome[2];
+    double threshold, tolerance, diff = HUGE_VAL, total;
+    size_t c, mapped;
+    int i, n = frac -> numfuncs, round;
+    if ((m = (double *)malloc(6 * n * sizeof(double))) == NULL){
+        fprintf(stderr, "Malloc failed. (generateifs)\n");
+        exit(1);
+    }
+    memset(colours, 0, sizeof(colours));
+    clearmatrix(frac);
+    search(&sr, frac, window, m, 0);
+
+    /* Push the measure through the functions until it settles. The
+     * measure leaving the grid is dropped and the rest rescaled */
+    mass     = (double *)growscratch(mass, &masscap, sr.numcells, sizeof(double));
+    nextmass = (double *)realloc(nextmass, masscap * sizeof(double));
+    if (nextmass == NULL){
+        fprintf(stderr, "Malloc failed. (generateifs)\n");
+        exit(1);
+    }
+    threshold = M_LN2/frac -> numpoints;
+    tolerance = IFSTOLERANCE * threshold;
+    for (c = 0; c < sr.numcells; c++) mass[c] = 1.0/sr.numcells;
+    for (round = 0; round < IFSMAXROUNDS && diff > tolerance; round++){
+        double *t;
+        memset(nextmass, 0, sr.numcells * sizeof(double));
+        for (c = 0; c < sr.numcells; c++){
+            for (i = 0; i < n; i++){
+                if (targets[n*c + i] >= 0) nextmass[targets[n*c + i]] += p[i] * mass[c];
+            }
+        }
+        total = 0;
+        for (c = 0; c < sr.numcells; c++) total += nextmass[c];
+        if (total <= 0) break;
+        diff = 0;
+        for (c = 0; c < sr.numcells; c++){
+            nextmass[c] /= total;
+            diff += fabs(nextmass[c] - mass[c]);
+        }
+        t = mass; mass = nextmass; nextmass = t;
+    }
+    frac -> converged = (diff <= tolerance);
+
+    /* Draw the pixels the chaos game would more likely than not have
+     * hit with numpoints points, those with numpoints * measure of at
+     * least ln 2 */
+    c = pixmasscap;
+    pixmass = (double *)growscratch(pixmass, &pixmasscap, (size_t)sr.width * sr.height, sizeof(double));
+    if (pixmasscap != c) memset(pixmass, 0, pixmasscap * sizeof(double)); //kept zeroed between renders
+    for (c = 0; c < sr.numcells; c++){
+        double x = sr.points[2*c], y = sr.points[2*c + 1];
+        if (x >= 0 && x < sr.width && y >= 0 && y < sr.height) pixmass[(size_t)y * sr.width + (size_t)x] += mass[c];
+    }
+    for (c = 0; c < sr.numcells; c++){
+        double x = sr.points[2*c], y = sr.points[2*c + 1];
+        if (!(x >= 0 && x < sr.width && y >= 0 && y < sr.height)) continue;
+        if (pixmass[(size_t)y * sr.width + (size_t)x] >= threshold){
+            pixx[pixels] = (int)x;
+            pixy[pixels] = (int)y;
+            if (++pixels == IFSBATCH){
+                stamppixels(frac, pixx, pixy, colours, IFSBATCH);
+                pixels = 0;
+            }
+        }
+    }
+    if (pixels > 0) stamppixels(frac, pixx, pixy, colours, pixels);
+    for (c = 0; c < sr.numcells; c++){
+        double x = sr.points[2*c], y = sr.points[2*c + 1];
+        if (x >= 0 && x < sr.width && y >= 0 && y < sr.height) pixmass[(size_t)y * sr.width + (size_t)x] = 0;
+    }
+
+    double sx = sr.width/(window[1] - window[0]);
+    double sy = sr.height/(window[3] - window[2]);
+    extrema[0] = window[0] + sr.ext[0]/sx;
+    extrema[1] = window[0] + sr.ext[1]/sx;
+    extrema[2] = window[3] - sr.ext[3]/sy;
+    extrema[3] = window[3] - sr.ext[2]/sy;
+    mapped = sr.numcells * (size_t)n * (round + 1);
+    frac -> pointsused = (mapped > 2147483647UL) ? 2147483647 : (int)mapped;
+    finishmatrix(frac);
+    free(m);
+}
+
+void ifsthreadfree(void){
+    /* This function frees the scratch of the calling thread */
+    free(inside);
+    free(keys);
+    free(cells);
+    free(points);
+    free(targets);
+    free(mass);
+    free(nextmass);
+    free(pixmass);
+    inside = NULL;
+    keys = NULL;
+    cells = NULL;
+    points = NULL;
+    targets = NULL;
+    mass = nextmass = pixmass = NULL;
+    insidecap = tablesize = capacity = targetcap = masscap = pixmasscap = 0;
+}
+
+void ifsimage(const double *params, int numfuncs, const double *window, const struct Bitmap *src, struct Bitmap *dst){
+    /* This function draws f_1(src) u ... u f_n(src) into dst, where
+     * params holds the 4 multiplicative parameters of every function
+     * followed by their 2 additive ones (as in fracdata.dat). src and
+     * dst are bit maps of the same size drawn in window, and dst is
+     * cleared first
+     */
+    struct Canvas cv;
+    double m[6*IFSIMAGEFUNCS], *mp = m;
+    int i, y, x, x0, x1;
+    if (numfuncs > IFSIMAGEFUNCS && (mp = (double *)malloc(6 * numfuncs * sizeof(double))) == NULL){
+        fprintf(stderr, "Malloc failed. (ifsimage)\n");
+        exit(1);
+    }
+    pixelmaps(params, params + 4*numfuncs, numfuncs, window, src -> width, src -> height, mp);
+    bmclear(dst);
+    cv.m        = mp;
+    cv.numfuncs = numfuncs;
+    cv.width    = src -> width;
+    cv.height   = src -> height;
+    cv.words    = src -> stride;
+    cv.next     = (uint64_t *)dst -> data;
+    cv.lo       = cv.height;
+    cv.hi       = -1;
+    cv.ext[0] = cv.ext[2] = HUGE_VAL;
+    cv.ext[1] = cv.ext[3] = -HUGE_VAL;
+    for (y = 0; y < src -> height; y++){
+        const uint64_t *row = (const uint64_t *)src -> data + (size_t)y * src -> stride;
+        for (x = 0; nextrun(row, cv.words, x, &x0, &x1); x = x1){
+            double cx0 = x0 + 0.5, cx1 = x1 - 0.5, cy = y + 0.5;
+            for (i = 0; i < numfuncs; i++){
+                double *f = mp + 6*i;
+                drawsegment(&cv, f[0] * cx0 + f[1] * cy + f[4], f[2] * cx0 + f[3] * cy + f[5],
+                                 f[0] * cx1 + f[1] * cy + f[4], f[2] * cx1 + f[3] * cy + f[5]);
+            }
+        }
+    }
+    if (mp != m) free(mp);
+}
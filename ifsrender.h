@@ -0,0 +1,24 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: ifsrender.h
+ *
+ * The deterministic renderer (--deterministic, ENGINE_IFS) and the
+ * one step map of a bit map used by the collage distance.
+ *
+ * Unlike stamppoints, which clamps the points of the chaos game that
+ * leave the window onto columns 1 and width-1 and rows 1 and
+ * height-1, these drop the parts of an attractor or image outside
+ * the window, so the chaos game picture of an attractor leaving the
+ * window has lines along its edges that the deterministic one does
+ * not. Inside the window generateifs draws the pixels the chaos game
+ * is more likely than not to hit with numpoints points, so the two
+ * still differ in the faintest pixels, about as much as two chaos
+ * games with different seeds do.
+ */
+struct Fractal;
+struct Bitmap;
+void generateifs(struct Fractal *frac, double *window, double *extrema);
+int ifsinside(struct Fractal *frac, double *window);
+void ifsimage(const double *params, int numfuncs, const double *window, const struct Bitmap *src, struct Bitmap *dst);
+void ifsthreadfree(void);
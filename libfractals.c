@@ -0,0 +1,213 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: libfractals.c
+ *
+ * This file contains the C API of libfractals.so, see libfractals.h.
+ * It builds a FracConfig from the arguments, draws the fractal with
+ * makefrac or makefracgenome and copies out the picture and the
+ * statistics. Fractals are always streamed, so no points are kept.
+ * Each thread keeps one fractal that every call is drawn in, so a
+ * call does not allocate unless it needs a bigger one. It and the
+ * scratch buffers of the calling thread are freed when the thread
+ * exits (see keepthread). Text matrices
+ * are read with matrix_load, and collages are scored with collagebatch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "Fractals.h"
+#include "fracfuncs.h"
+#include "matvec_read.h"
+#include "collage.h"
+#include "ifsrender.h"
+#include "libfractals.h"
+
+#define FRAC_RETIRED (16 | 64) //flags no longer accepted, see libfractals.h
+
+static __thread struct Fractal *apifrac = NULL; //the fractal of the calling thread
+static __thread int apikeyset = 0;              //whether it is freed on exit
+static pthread_key_t apikey;                     //by freethread
+static pthread_once_t apionce = PTHREAD_ONCE_INIT;
+static int apikeymade = 0;
+
+static void freethread(void *unused){
+    /* This function frees the fractal and the scratch buffers of a
+     * thread that is exiting. Its thread local variables can still
+     * be used while the key destructors run
+     */
+    (void)unused;
+    if (apifrac != NULL) freefrac(apifrac);
+    apifrac = NULL;
+    bmthreadfree();
+    ifsthreadfree();
+    collagethreadfree();
+}
+
+static void makeapikey(void){
+    apikeymade = pthread_key_create(&apikey, freethread) == 0;
+}
+
+static void keepthread(void){
+    /* This function registers the calling thread to have its fractal
+     * and scratch freed by freethread when it exits, eg. a worker of
+     * a DataLoader or of a thread pool calling the API
+     */
+    if (apikeyset) return;
+    pthread_once(&apionce, makeapikey);
+    if (apikeymade) pthread_setspecific(apikey, &apikey);
+    apikeyset = 1;
+}
+
+__attribute__((destructor))
+static void deleteapikey(void){
+    /* This function deletes the key when the library is unloaded, so
+     * no thread exiting later calls into the unloaded library
+     */
+    if (apikeymade) pthread_key_delete(apikey);
+}
+
+static int apiconfig(struct FracConfig *cfg, int numfuncs, int numpoints, int width, int height,
+                     const double *window, int flags){
+    /* This function fills in the config of a call. It returns -1 if
+     * the arguments are out of range
+     */
+    if (numfuncs < 1 || numpoints < 1 || width < 8 || height < 8) return -1;
+    if (window != NULL && (!(window[1] > window[0]) || !(window[3] > window[2]))) return -1;
+    defaultconfig(cfg, numfuncs, numpoints);
+    if (window != NULL) memcpy(cfg -> window, window, 4 * sizeof(double));
+    cfg -> width   = width;
+    cfg -> height  = height;
+    cfg -> stream  = 1;
+    cfg -> cutoff  = (flags & FRAC_CUTOFF) != 0;
+    cfg -> autofit = (flags & FRAC_AUTOFIT) != 0;
+    if (flags & FRAC_RETIRED) return -1;
+    if ((flags & FRAC_FLOAT32) && (flags & FRAC_DETERMINISTIC)) return -1;
+    if (flags & FRAC_SIMD) cfg -> engine = ENGINE_SIMD;
+    if (flags & FRAC_FLOAT32){
+        cfg -> engine    = ENGINE_SIMD;
+        cfg -> precision = PREC_FLOAT;
+    }
+    if (flags & FRAC_DETERMINISTIC) cfg -> engine = ENGINE_IFS;
+    return 0;
+}
+
+static void apiresults(struct Fractal *frac, unsigned char *image, struct FracStats *stats){
+    /* This function works out the statistics of a drawn fractal and
+     * copies them and its picture out
+     */
+    int x, y;
+    struct Bitmap *bm = &frac -> bm;
+    stddev(frac);
+    dimension(frac);
+    if (image != NULL){
+        for (y = 0; y < bm -> height; y++){
+            for (x = 0; x < bm -> width; x++){
+                image[(size_t)y * bm -> width + x] = (unsigned char)bmget(bm, x, y);
+            }
+        }
+    }
+    if (stats != NULL){
+        memset(stats, 0, sizeof(struct FracStats));
+        stats -> numfuncs    = frac -> numfuncs;
+        stats -> pointsused  = frac -> pointsused;
+        stats -> numb        = frac -> numb;
+        stats -> flags       = frac -> converged ? 0 : FRACSTAT_UNCONVERGED;
+        stats -> avgx        = frac -> avgx;
+        stats -> avgy        = frac -> avgy;
+        stats -> stddevx     = frac -> stddevx;
+        stats -> stddevy     = frac -> stddevy;
+        stats -> dimension   = frac -> dimension;
+        stats -> covxy       = frac -> covxy;
+        stats -> orientation = frac -> orientation;
+        memcpy(stats -> window, frac -> window, 4 * sizeof(double));
+        stats -> seed        = frac -> seed;
+    }
+}
+
+FRACAPI int fracapiversion(void){
+    return FRACAPI_VERSION;
+}
+
+FRACAPI uint64_t fracapiseed(uint64_t masterseed, int fracnum){
+    return fracseed(masterseed, fracnum);
+}
+
+FRACAPI int fracrenderseed(uint64_t seed, int numfuncs, int numpoints, int width, int height,
+                           const double *window, int flags, unsigned char *image,
+                           double *genome, struct FracStats *stats){
+    struct FracConfig cfg;
+    int i;
+    if (apiconfig(&cfg, numfuncs, numpoints, width, height, window, flags) != 0) return -1;
+    keepthread();
+    if (apifrac == NULL) apifrac = makefrac(&cfg, seed);
+    else remakefrac(apifrac, &cfg, seed);
+    struct Fractal *frac = apifrac;
+    if (genome != NULL){
+        for (i = 0; i < 4; i++){
+            int len = (i == 0) ? 4*numfuncs : (i == 1) ? 2*numfuncs : numfuncs;
+            memcpy(genome, frac -> genome[i], len * sizeof(double));
+            genome += len;
+        }
+    }
+    apiresults(frac, image, stats);
+    return 0;
+}
+
+FRACAPI int fracrendergenome(const double *params, const double *probs, int numfuncs, int numpoints,
+                             int width, int height, const double *window, int flags, uint64_t seed,
+                             unsigned char *image, struct FracStats *stats){
+    struct FracConfig cfg;
+    if (params == NULL) return -1;
+    if (apiconfig(&cfg, numfuncs, numpoints, width, height, window, flags & ~FRAC_CUTOFF) != 0) return -1;
+    keepthread();
+    if (apifrac == NULL) apifrac = makefracgenome(&cfg, params, probs, seed);
+    else remakefracgenome(apifrac, &cfg, params, probs, seed);
+    apiresults(apifrac, image, stats);
+    return 0;
+}
+
+FRACAPI int fracloadmatrix(const char *filename, int flags, double **matrix, int *rows, int *cols){
+    if (filename == NULL || matrix == NULL || rows == NULL || cols == NULL) return -1;
+    *matrix = matrix_load(filename, rows, cols, (flags & FRACLOAD_CACHE) ? MATRIX_CACHE : 0);
+    return (*matrix == NULL) ? -1 : 0;
+}
+
+FRACAPI void fracfreematrix(double *matrix){
+    free(matrix);
+}
+
+FRACAPI int fraccollage(const double *params, int count, int numfuncs, const unsigned char *target,
+                        int width, int height, const double *window, int threads, double *scores){
+    struct Bitmap bm;
+    struct Score *results;
+    double defaultwindow[4] = {-8, 8, -8, 8};
+    int x, y, i;
+    if (params == NULL || target == NULL || scores == NULL) return -1;
+    if (count < 1 || numfuncs < 1 || width < 8 || height < 8) return -1;
+    if (window != NULL && (!(window[1] > window[0]) || !(window[3] > window[2]))) return -1;
+    if ((results = (struct Score *)malloc(count * sizeof(struct Score))) == NULL) return -1;
+    keepthread();
+    bmalloc(&bm, width, height, PIX_BIT, LAYOUT_ROWS);
+    bmclear(&bm);
+    for (y = 0; y < height; y++){
+        uint64_t *row = (uint64_t *)bm.data + (size_t)y * bm.stride;
+        for (x = 0; x < width; x++){
+            if (target[(size_t)y * width + x] != 0) row[x >> 6] |= 1ULL << (x & 63);
+        }
+    }
+    collagebatch(params, count, numfuncs, (window != NULL) ? window : defaultwindow, &bm, results,
+                 (threads < 1) ? 1 : threads);
+    for (i = 0; i < count; i++){
+        scores[5*i + 0] = results[i].iou;
+        scores[5*i + 1] = results[i].precision;
+        scores[5*i + 2] = results[i].recall;
+        scores[5*i + 3] = results[i].chamfer;
+        scores[5*i + 4] = results[i].hausdorff;
+    }
+    bmfree(&bm);
+    free(results);
+    return 0;
+}
@@ -0,0 +1,102 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: libfractals.h
+ *
+ * The C API of libfractals.so (make libfractals.so), used by
+ * dataset.py to draw fractals on the fly. Every call works on its
+ * own fractal, so the functions can be called from any number of
+ * threads or processes at once. The memory a thread uses is kept
+ * between its calls and freed when the thread exits.
+ *
+ * A picture is written to image, width x height bytes in rows from
+ * the top, 1 where the attractor is and 0 elsewhere. image or stats
+ * may be NULL if they are not wanted. The functions return 0, or
+ * -1 if an argument is out of range.
+ *
+ * Functions and flags are only ever added to this API; FRACAPI_VERSION
+ * is raised when one is, and struct FracStats only grows at the end.
+ * The flags taken away, FRAC_DIRECTGENOMES and FRAC_FIXED32, are
+ * rejected rather than given another meaning.
+ */
+#ifndef LIBFRACTALS_H
+#define LIBFRACTALS_H
+
+#include <stdint.h>
+
+#define FRACAPI_VERSION 7
+
+#define FRAC_CUTOFF        1 //redraw the genome until the attractor is inside the window
+#define FRAC_AUTOFIT       2 //fit the window tightly around the attractor
+#define FRAC_DETERMINISTIC 4 //draw from the invariant measure instead of the chaos game
+#define FRAC_SIMD          8 //run the chaos game as simd walkers
+#define FRAC_FLOAT32       32 //run the simd walkers in float (version 5)
+                              //16 was FRAC_DIRECTGENOMES (versions 2 to 6), a direct
+                              //sampler of contractive matrices, and 64 FRAC_FIXED32
+                              //(versions 5 and 6), fixed point walkers. Both were
+                              //slower than what they replaced and are now rejected
+                              //as out of range (version 7)
+
+#define FRACSTAT_UNCONVERGED 1 //FracStats flag: FRAC_DETERMINISTIC gave up before
+                               //the picture settled, so pixels may be missing (version 6)
+
+#define FRACLOAD_CACHE 1 //keep the parsed matrix in filename.mat (version 3)
+
+#if defined(__GNUC__)
+#define FRACAPI __attribute__((visibility("default")))
+#else
+#define FRACAPI
+#endif
+
+struct FracStats{
+    /* The fracdata.dat columns of a fractal, see generatedata.c */
+    int32_t numfuncs, pointsused, numb, flags;
+    double avgx, avgy, stddevx, stddevy, dimension;
+    double covxy, orientation;
+    double window[4];     //the window the fractal was drawn in
+    uint64_t seed;
+};
+
+FRACAPI int fracapiversion(void);
+
+/* The seed of fractal fracnum of a generatedata run with master seed masterseed */
+FRACAPI uint64_t fracapiseed(uint64_t masterseed, int fracnum);
+
+/* Draws the fractal generatedata --render SEED draws with the same
+ * options (generatedata uses FRAC_CUTOFF unless --no-cutoff). window
+ * is minx, maxx, miny, maxy, or NULL for [-8,8]x[-8,8]. If genome is
+ * not NULL it gets the 8 x numfuncs genome columns of fracdata.dat:
+ * the multiplicative and additive parameters, the probabilities and
+ * the spectral radii. With FRAC_DETERMINISTIC and FRAC_CUTOFF a
+ * genome whose picture does not settle is redrawn, without the
+ * cutoff stats -> flags gets FRACSTAT_UNCONVERGED */
+FRACAPI int fracrenderseed(uint64_t seed, int numfuncs, int numpoints, int width, int height,
+                           const double *window, int flags, unsigned char *image,
+                           double *genome, struct FracStats *stats);
+
+/* Draws the fractal of a given genome: params is the 4 multiplicative
+ * and then 2 additive parameters of each function (the 6 x numfuncs
+ * columns dataset.py trains on) and probs their probabilities, or
+ * NULL to weight them by spectral radius. seed sets the chaos game's
+ * random stream. FRAC_CUTOFF is ignored */
+FRACAPI int fracrendergenome(const double *params, const double *probs, int numfuncs, int numpoints,
+                             int width, int height, const double *window, int flags, uint64_t seed,
+                             unsigned char *image, struct FracStats *stats);
+
+/* Reads a text matrix such as fracdata.dat with matrix_load (see
+ * matvec_read.h). *matrix is set to the rows x cols doubles, row by
+ * row, which are freed with fracfreematrix. Returns -1 if the file
+ * cannot be read (version 3) */
+FRACAPI int fracloadmatrix(const char *filename, int flags, double **matrix, int *rows, int *cols);
+FRACAPI void fracfreematrix(double *matrix);
+
+/* Scores the collages of count genomes (6 x numfuncs parameters each,
+ * one after the other) on a target picture, width x height bytes in
+ * rows from the top, nonzero where the target is, drawn in window
+ * (or NULL for [-8,8]x[-8,8]), see collage.h. No chaos game is run.
+ * scores gets 5 doubles per genome: iou, precision, recall, chamfer
+ * and hausdorff. threads threads are used (version 4) */
+FRACAPI int fraccollage(const double *params, int count, int numfuncs, const unsigned char *target,
+                        int width, int height, const double *window, int threads, double *scores);
+
+#endif
@@ -0,0 +1,101 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: manifest.c
+ *
+ * Reading and writing the fracdata.idx manifest (see manifest.h).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "manifest.h"
+
+_Static_assert(sizeof(struct Manifest) == 64, "the manifest must be 64 bytes");
+
+static uint64_t scanlines(const char *datafile, uint64_t start, uint64_t *bytes){
+    /* This function counts the complete lines of a file from byte
+     * start on, and sets bytes to the offset just past the last
+     * newline (or to start if there is none)
+     */
+    char buf[1 << 16];
+    uint64_t rows = 0, offset = start;
+    size_t n;
+    FILE *fp = fopen(datafile, "rb");
+    *bytes = start;
+    if (fp == NULL) return 0;
+    if (fseeko(fp, (off_t)start, SEEK_SET) != 0){
+        fclose(fp);
+        return 0;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0){
+        char *p = buf, *end = buf + n;
+        while ((p = memchr(p, '\n', end - p)) != NULL){
+            rows++;
+            p++;
+            *bytes = offset + (p - buf);
+        }
+        offset += n;
+    }
+    fclose(fp);
+    return rows;
+}
+
+int resumedata(const char *datafile, const char *manifestfile, struct Manifest *m){
+    /* This function works out where a run writing to datafile should
+     * resume, filling m with the committed rows and bytes and the
+     * master seed that wrote them. If the manifest is valid and no
+     * longer than the data file only the bytes after it are read
+     * (complete lines there, written just before a run was killed,
+     * are kept); otherwise the whole file is scanned. A partial last
+     * line is cut off. It returns 1 if a manifest was used, else 0
+     */
+    struct stat st;
+    int fd, used = 0;
+    memset(m, 0, sizeof(struct Manifest));
+    memcpy(m -> magic, MANIFESTMAGIC, 8);
+    if (stat(datafile, &st) != 0) return 0;
+    if ((fd = open(manifestfile, O_RDONLY)) >= 0){
+        struct Manifest disk;
+        if (read(fd, &disk, sizeof(disk)) == sizeof(disk) && memcmp(disk.magic, MANIFESTMAGIC, 8) == 0
+            && disk.bytes <= (uint64_t)st.st_size){
+            *m = disk;
+            used = 1;
+        }
+        close(fd);
+    }
+    m -> rows += scanlines(datafile, m -> bytes, &m -> bytes);
+    if ((uint64_t)st.st_size > m -> bytes){
+        fprintf(stderr, "Dropping %llu bytes of a partial line from the end of %s\n",
+                (unsigned long long)(st.st_size - m -> bytes), datafile);
+        if (truncate(datafile, m -> bytes) != 0){
+            fprintf(stderr, "Failed to truncate file (resumedata): %s\n", datafile);
+            exit(1);
+        }
+    }
+    return used;
+}
+
+int openmanifest(const char *manifestfile){
+    /* This function opens (creating if needed) a manifest for writing */
+    int fd = open(manifestfile, O_WRONLY | O_CREAT, 0644);
+    if (fd < 0){
+        fprintf(stderr, "Failed to open file (openmanifest): %s\n", manifestfile);
+        exit(1);
+    }
+    return fd;
+}
+
+void writemanifest(int fd, struct Manifest *m){
+    /* This function overwrites the manifest with m. It is a single
+     * 64 byte write at offset 0, so a killed run leaves either the
+     * old or the new manifest, never a mix
+     */
+    if (pwrite(fd, m, sizeof(struct Manifest), 0) != sizeof(struct Manifest)){
+        fprintf(stderr, "Failed to write the manifest (writemanifest)\n");
+        exit(1);
+    }
+}
@@ -0,0 +1,32 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: manifest.h
+ *
+ * The manifest is a small binary sidecar to fracdata.dat,
+ * fracdata.idx, recording how many lines of fracdata.dat have
+ * been committed and how many bytes they take. It is rewritten in
+ * place after every commit, so a run can be resumed by reading
+ * only the end of fracdata.dat past the committed bytes, where a
+ * line cut off by a killed run is dropped.
+ */
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdint.h>
+
+#define MANIFESTMAGIC "FRACIDX1"
+
+struct Manifest{
+    char magic[8];
+    uint64_t rows;        //lines committed to fracdata.dat
+    uint64_t bytes;       //size of fracdata.dat holding those lines
+    uint64_t masterseed;  //master seed of the run that wrote them
+    uint64_t reserved[4];
+};
+
+int resumedata(const char *datafile, const char *manifestfile, struct Manifest *m);
+int openmanifest(const char *manifestfile);
+void writemanifest(int fd, struct Manifest *m);
+
+#endif
@@ -2,117 +2,417 @@
  * and is being used with his permission
  *
  * FILE NAME: matvec_read.c
- * 
- * The function in this file reads in a matrix
- * stored in the file filename, and calculates 
- * the number of rows and columns as it does so
+ *
+ * The functions in this file read in a matrix
+ * stored in the file filename, and calculate
+ * the number of rows and columns as they do so
+ *
+ * The file is memory mapped and cut at line boundaries into one
+ * chunk per thread. Each thread counts the rows of its chunk, then,
+ * once the row each chunk starts at is known, parses its rows
+ * straight into the matrix. Numbers are read by parsedouble, which
+ * does not depend on the locale and only hands a number to strtod
+ * when it cannot round it exactly itself.
  */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <float.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "matvec_read.h"
 
+#define MATRIXCHUNK (1 << 20) //bytes of text per thread, at least
+#define MATRIXMAXTHREADS 64
+
+struct Chunk{
+    /* The part of the text one thread reads */
+    const char *start, *end;
+    int cols;
+    long rows;            //the rows in the chunk
+    long firstrow;        //the row of the matrix the chunk starts at
+    double *matrix;
+    long badrow;          //the first entry that is not a number, or -1
+    int badcol;
+    const char *badtok, *badend;
+};
+
+static const double pow10d[23] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#if LDBL_MANT_DIG >= 64
+static const long double pow10l[28] = {
+    1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 1e10L, 1e11L,
+    1e12L, 1e13L, 1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L, 1e21L, 1e22L,
+    1e23L, 1e24L, 1e25L, 1e26L, 1e27L
+};
+#endif
+
+static inline int isdelim(char c){
+    return c == ' ' || c == '\t' || c == ',' || c == '\r';
+}
+
+static inline const char *skipdelims(const char *p, const char *end){
+    while (p < end && isdelim(*p)) p++;
+    return p;
+}
+
+static int parsedouble(const char *p, const char *end, double *val){
+    /* This function parses the decimal number p to end into *val,
+     * correctly rounded. It returns 0 if it cannot: the number is not
+     * plain decimal (inf, nan, hex), has more than 19 significant
+     * digits, or is too large or small to round exactly with the
+     * powers of ten above.
+     *
+     * m x 10^e is exact in a double when m <= 2^53 and |e| <= 22, so
+     * one multiply or divide rounds it correctly. With a 64 bit long
+     * double m and 10^e are exact up to 19 digits and |e| <= 27, and
+     * rounding the long double result to a double is only wrong if
+     * it fell exactly halfway between two doubles, which is checked.
+     */
+    uint64_t m = 0;
+    int neg = 0, digits = 0, exp10 = 0, seen = 0, e = 0, eneg = 0;
+    if (p < end && (*p == '-' || *p == '+')){
+        neg = (*p == '-');
+        p++;
+    }
+    for (; p < end && *p >= '0' && *p <= '9'; p++, seen = 1){
+        if (digits < 19){
+            m = 10*m + (*p - '0');
+            if (m != 0) digits++;
+        }
+        else if (*p != '0') return 0;
+        else exp10++;
+    }
+    if (p < end && *p == '.'){
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, seen = 1){
+            if (digits < 19){
+                m = 10*m + (*p - '0');
+                if (m != 0) digits++;
+                exp10--;
+            }
+            else if (*p != '0') return 0;
+        }
+    }
+    if (!seen) return 0;
+    if (p < end && (*p == 'e' || *p == 'E')){
+        p++;
+        if (p < end && (*p == '-' || *p == '+')){
+            eneg = (*p == '-');
+            p++;
+        }
+        if (p == end) return 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++){
+            if (e < 10000) e = 10*e + (*p - '0');
+        }
+        exp10 += eneg ? -e : e;
+    }
+    if (p != end) return 0;
+    if (m == 0){
+        *val = neg ? -0.0 : 0.0;
+        return 1;
+    }
+    if (m <= (1ULL << 53) && exp10 >= -22 && exp10 <= 22){
+        double d = (exp10 < 0) ? (double)m/pow10d[-exp10] : (double)m * pow10d[exp10];
+        *val = neg ? -d : d;
+        return 1;
+    }
+#if LDBL_MANT_DIG >= 64
+    if (exp10 >= -27 && exp10 <= 27){
+        long double l = (exp10 < 0) ? (long double)m/pow10l[-exp10] : (long double)m * pow10l[exp10];
+        double d = (double)l;
+        if (l != ((long double)d + nextafter(d, INFINITY))/2 &&
+            l != ((long double)d + nextafter(d, -INFINITY))/2){
+            *val = neg ? -d : d;
+            return 1;
+        }
+    }
+#endif
+    return 0;
+}
+
+static int parsetoken(const char *p, const char *end, double *val){
+    /* This function parses the entry p to end into *val, returning
+     * 0 if it is not a number */
+    char buf[64], *s = buf, *stop;
+    size_t len = end - p;
+    int ok;
+    if (parsedouble(p, end, val)) return 1;
+    if (len >= sizeof(buf) && (s = (char *)malloc(len + 1)) == NULL){
+        fprintf(stderr, "malloc failed\n");
+        return 0;
+    }
+    memcpy(s, p, len);
+    s[len] = '\0';
+    *val = strtod(s, &stop);
+    ok = (len > 0 && stop == s + len);
+    if (s != buf) free(s);
+    return ok;
+}
+
+static void *countrows(void *arg){
+    /* This function counts the rows of a chunk, skipping blank lines */
+    struct Chunk *ch = (struct Chunk *)arg;
+    const char *p = ch -> start, *q;
+    long n = 0;
+    while (p < ch -> end){
+        if ((q = memchr(p, '\n', ch -> end - p)) == NULL) q = ch -> end;
+        if (skipdelims(p, q) < q) n++;
+        p = q + 1;
+    }
+    ch -> rows = n;
+    return NULL;
+}
+
+static void *parserows(void *arg){
+    /* This function parses the rows of a chunk into the matrix.
+     * Additional entries are ignored; missing entries are zero. */
+    struct Chunk *ch = (struct Chunk *)arg;
+    const char *p = ch -> start, *q, *t;
+    double *row = ch -> matrix + (size_t)ch -> firstrow * ch -> cols;
+    long r = ch -> firstrow;
+    int n;
+    while (p < ch -> end){
+        if ((q = memchr(p, '\n', ch -> end - p)) == NULL) q = ch -> end;
+        p = skipdelims(p, q);
+        if (p == q){
+            p = q + 1;
+            continue;
+        }
+        for (n = 0; n < ch -> cols; n++){
+            if (p == q){
+                row[n] = 0;
+                continue;
+            }
+            for (t = p; t < q && !isdelim(*t); t++);
+            if (!parsetoken(p, t, row + n)){
+                ch -> badrow = r;
+                ch -> badcol = n;
+                ch -> badtok = p;
+                ch -> badend = t;
+                return NULL;
+            }
+            p = skipdelims(t, q);
+        }
+        row += ch -> cols;
+        r++;
+        p = q + 1;
+    }
+    return NULL;
+}
+
+static void runchunks(void *(*func)(void *), struct Chunk *chunks, int numchunks){
+    /* This function runs func on every chunk, one thread each */
+    pthread_t threads[MATRIXMAXTHREADS];
+    int started[MATRIXMAXTHREADS];
+    int i;
+    for (i = 1; i < numchunks; i++){
+        started[i] = (pthread_create(&threads[i], NULL, func, &chunks[i]) == 0);
+        if (!started[i]) func(&chunks[i]);
+    }
+    func(&chunks[0]);
+    for (i = 1; i < numchunks; i++){
+        if (started[i]) pthread_join(threads[i], NULL);
+    }
+}
+
+static double *readcache(const char *name, const struct stat *src, int *rows, int *cols){
+    /* This function reads the matrix in the cache file name, or
+     * returns NULL if there is none or it is not from the text file
+     * with stat src */
+    struct MatrixCache head;
+    struct stat st;
+    double *matrix;
+    size_t bytes, got = 0;
+    ssize_t n;
+    int fd;
+    if ((fd = open(name, O_RDONLY)) < 0) return NULL;
+    if (fstat(fd, &st) != 0 || read(fd, &head, sizeof(head)) != (ssize_t)sizeof(head) ||
+        memcmp(head.magic, MATRIX_MAGIC, 8) != 0 || head.headerbytes != sizeof(head) ||
+        head.rows < 1 || head.cols < 1 || head.srcsize != (uint64_t)src -> st_size ||
+        head.srcmtime != (int64_t)src -> st_mtim.tv_sec ||
+        head.srcmtimensec != (int64_t)src -> st_mtim.tv_nsec){
+        close(fd);
+        return NULL;
+    }
+    bytes = (size_t)head.rows * head.cols * sizeof(double);
+    if ((size_t)st.st_size != sizeof(head) + bytes || (matrix = (double *)malloc(bytes)) == NULL){
+        close(fd);
+        return NULL;
+    }
+    while (got < bytes && (n = read(fd, (char *)matrix + got, bytes - got)) > 0) got += n;
+    close(fd);
+    if (got != bytes){
+        free(matrix);
+        return NULL;
+    }
+    *rows = head.rows;
+    *cols = head.cols;
+    return matrix;
+}
+
+static void writecache(const char *name, const struct stat *src, const double *matrix, int rows, int cols){
+    /* This function writes the cache file name. It is written to a
+     * temporary file and renamed, so a reader never sees half of it.
+     * The cache is only a speed up, so failing to write it is not an
+     * error. */
+    struct MatrixCache head;
+    char tmpname[4200];
+    FILE *out;
+    int ok;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, MATRIX_MAGIC, 8);
+    head.headerbytes  = sizeof(head);
+    head.rows         = rows;
+    head.cols         = cols;
+    head.srcsize      = src -> st_size;
+    head.srcmtime     = src -> st_mtim.tv_sec;
+    head.srcmtimensec = src -> st_mtim.tv_nsec;
+    snprintf(tmpname, sizeof(tmpname), "%s.tmp%ld", name, (long)getpid());
+    if ((out = fopen(tmpname, "wb")) == NULL) return;
+    ok = (fwrite(&head, sizeof(head), 1, out) == 1 &&
+          fwrite(matrix, sizeof(double), (size_t)rows * cols, out) == (size_t)rows * cols);
+    ok = (fclose(out) == 0) && ok;
+    if (!ok || rename(tmpname, name) != 0) remove(tmpname);
+}
+
+double *matrix_load(const char *filename, int *rows, int *cols, int flags){
+    /* Read a text file that defines a matrix.
+     * Each row should have the same number of entries as the first row.
+     * Additional entries are ignored; missing entries are treated as zero.
+     * Entries in a row are separated by whitespace or commas, and
+     * blank lines are skipped.
+     *
+     * Arguments:
+     *        input file name,
+     *        pointer to int to store number of rows
+     *        pointer to int to store number of columns
+     *        MATRIX_CACHE to use the filename.mat cache, or 0
+     *
+     * Returns:
+     *        NULL pointer on failure
+     *        Pointer to the rows x cols matrix, row by row, otherwise.
+     */
+    struct Chunk chunks[MATRIXMAXTHREADS];
+    struct stat st;
+    char cachefile[4096];
+    const char *text, *p, *q, *end;
+    double *matrix = NULL;
+    long total = 0;
+    int fd, i, numchunks, usecache = 0;
+    long cpus;
+
+    if ((fd = open(filename, O_RDONLY)) < 0 || fstat(fd, &st) != 0){
+        fprintf(stderr, "Failed to open file %s.\n", filename);
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    if (flags & MATRIX_CACHE){
+        usecache = (snprintf(cachefile, sizeof(cachefile), "%s.mat", filename) < (int)sizeof(cachefile));
+        if (usecache && (matrix = readcache(cachefile, &st, rows, cols)) != NULL){
+            close(fd);
+            return matrix;
+        }
+    }
+    if (st.st_size == 0){
+        fprintf(stderr, "File %s is empty.\n", filename);
+        close(fd);
+        return NULL;
+    }
+    text = (const char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED){
+        fprintf(stderr, "Failed to map file %s.\n", filename);
+        return NULL;
+    }
+    end = text + st.st_size;
+
+    /* The number of columns is the number of entries in the first row */
+    *cols = 0;
+    for (p = text; p < end; p = q + 1){
+        if ((q = memchr(p, '\n', end - p)) == NULL) q = end;
+        for (p = skipdelims(p, q); p < q; p = skipdelims(p, q)){
+            (*cols)++;
+            while (p < q && !isdelim(*p)) p++;
+        }
+        if (*cols > 0) break;
+    }
+    if (*cols == 0){
+        fprintf(stderr, "File %s is empty.\n", filename);
+        munmap((void *)text, st.st_size);
+        return NULL;
+    }
+
+    /* Cut the text into chunks that start at the beginning of a line */
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    numchunks = (int)(st.st_size/MATRIXCHUNK) + 1;
+    if (numchunks > cpus) numchunks = (cpus < 1) ? 1 : (int)cpus;
+    if (numchunks > MATRIXMAXTHREADS) numchunks = MATRIXMAXTHREADS;
+    p = text;
+    for (i = 0; i < numchunks; i++){
+        q = (i == numchunks - 1) ? end : text + (size_t)st.st_size * (i + 1)/numchunks;
+        if (q < p) q = p;
+        if (q < end && q > text && q[-1] != '\n'){
+            q = memchr(q, '\n', end - q);
+            q = (q == NULL) ? end : q + 1;
+        }
+        chunks[i].start  = p;
+        chunks[i].end    = q;
+        chunks[i].cols   = *cols;
+        chunks[i].badrow = -1;
+        p = q;
+    }
+    runchunks(countrows, chunks, numchunks);
+    for (i = 0; i < numchunks; i++){
+        chunks[i].firstrow = total;
+        total += chunks[i].rows;
+    }
+    if (total > 2147483647L || (matrix = (double *)malloc((size_t)total * *cols * sizeof(double))) == NULL){
+        fprintf(stderr, "malloc failed\n");
+        munmap((void *)text, st.st_size);
+        return NULL;
+    }
+    *rows = (int)total;
+    for (i = 0; i < numchunks; i++) chunks[i].matrix = matrix;
+    runchunks(parserows, chunks, numchunks);
+    for (i = 0; i < numchunks; i++){
+        if (chunks[i].badrow >= 0){
+            fprintf(stderr, "Error on row %ld column %d of input file %s: Trying to read: %.*s.\n",
+                    chunks[i].badrow + 1, chunks[i].badcol + 1, filename,
+                    (int)(chunks[i].badend - chunks[i].badtok), chunks[i].badtok);
+            free(matrix);
+            munmap((void *)text, st.st_size);
+            return NULL;
+        }
+    }
+    munmap((void *)text, st.st_size);
+    if (usecache) writecache(cachefile, &st, matrix, *rows, *cols);
+    return matrix;
+}
+
 double **matrix_read(char *filename, int *rows, int *cols) {
-	/* Read a text file that defines a matrix.
-	 * Each row should have the same number of entries as the first row. 
-	 * Additional entries are ignored; missing entries are treated as zero.
-	 * Entries in a row are separated by whitespace or commas.
-	 *
-	 * Arguments: 
-	 *		input file name,
-	 *		pointer to int to store number of rows
-	 *		pointer to int to store number of columns
-	 *
-	 * Returns:  
-	 *		NULL pointer on failure
-	 *		Pointer to pointer to double otherwise.  The matrix is 
-	 *			stored contiguously in memory.
-	 */
-
-	int m,n,rowlen;
-	double **matrix;
-	char b;
-	char *line,*tok;
-	char delimiters[5] = ", \t\n";
-	FILE *infile;
-
-	if ((infile = fopen(filename,"r")) == NULL) {
-		fprintf(stderr,"Failed to open file %s.\n",filename);
-		return NULL;
-	}
-	/* First read characters until the first newline character is encountered. */
-	rowlen = 0;
-	b = fgetc(infile);
-	while (b != EOF && b != '\n') {
-		rowlen++;
-		b = fgetc(infile);
-	}
-	rowlen += 2;
-	rewind(infile);
-	/* Allocate space for, and read the first line into a string. */
-	line = (char *) malloc(rowlen*sizeof(char));
-	fgets(line,rowlen,infile);
-	/* Count the number of entries in this line. */
-	tok = strtok(line,delimiters);
-	*cols = 0;
-	while (tok != NULL) {
-		(*cols)++;
-		tok = strtok(NULL,delimiters);
-	}
-	free(line);
-	/* Count the remaining lines, keeping track of the longest line. */
-	*rows = 1;
-	n = 0;
-	b = fgetc(infile);
-	while (b != EOF) {
-		if (b == '\n') {
-			(*rows)++;
-			if (n > rowlen) rowlen = n;
-		}
-		else
-			n++;
-		b = fgetc(infile);
-	}
-	/* Allocate space for longest line. */
-	line = (char *) malloc((rowlen+2)*sizeof(char));
-	/* Allocate space for the row pointers. */
-	if ((matrix = (double **) malloc(*rows*sizeof(double *))) == NULL) {
-		fprintf(stderr,"malloc failed\n");
-		fclose(infile);
-		return NULL;
-	}
-	/* Rewind file and read lines. */
-	rewind(infile);
-	/* Allocate space for all rows in contiguous region in memory. */
-	if ((matrix[0] = (double *) calloc((*rows)*(*cols),sizeof(double))) == NULL) {
-		fprintf(stderr,"calloc failed\n");
-		fclose(infile);
-		return NULL;
-	}
-	/* Read each line of file and record values. */
-	for (m=0; m<*rows; m++) {
-		/* Assign the row pointer to the appropriate location in the allocated space. */
-		matrix[m] = matrix[0] + *cols*m;
-		/* Get the line from the file. */
-		if (fgets(line,rowlen,infile) == NULL) {
-			fprintf(stderr,"Error reading input file line %d.\n",m+1);
-			fclose(infile);
-			return NULL;
-		}
-		/* Break the line by white space. */
-		tok = strtok(line,delimiters);
-		for (n=0; n<*cols; n++) {
-			if (tok == NULL) break;  /* missing columns treated as zeros */
-			if (sscanf(tok,"%lf",matrix[m]+n) != 1) {
-				fprintf(stderr,"Error on line %d column %d of input file %s:%s%s.\n",
-						m+1,n+1,filename," Trying to read: ",tok);
-				fclose(infile);
-				return NULL;
-			}
-			tok = strtok(NULL,delimiters);
-		}
-	}
-	free(line);
-	fclose(infile);
-	return matrix;
+    /* Read a text file that defines a matrix, see matrix_load.
+     *
+     * Returns:
+     *        NULL pointer on failure
+     *        Pointer to pointer to double otherwise.  The matrix is
+     *            stored contiguously in memory.
+     */
+    double **matrix;
+    double *data;
+    int m;
+    if ((data = matrix_load(filename, rows, cols, 0)) == NULL) return NULL;
+    if ((matrix = (double **)malloc(*rows * sizeof(double *))) == NULL){
+        fprintf(stderr, "malloc failed\n");
+        free(data);
+        return NULL;
+    }
+    for (m = 0; m < *rows; m++) matrix[m] = data + (size_t)*cols * m;
+    return matrix;
 }
@@ -1,2 +1,38 @@
-/* FILE NAME: matvec_read.h */
+/* FILE NAME: matvec_read.h
+ *
+ * matrix_load reads a text matrix (eg. fracdata.dat) into one
+ * contiguous rows x cols array of doubles, freed with free().
+ * matrix_read is the original interface: the same matrix with a
+ * pointer to each row, freed with free(matrix[0]); free(matrix).
+ *
+ * With MATRIX_CACHE the parsed matrix is kept in the binary file
+ * filename.mat next to the text file, and later loads read that
+ * instead as long as the text file has the same size and
+ * modification time. The .mat file is
+ *
+ *      struct MatrixCache
+ *      rows x cols doubles, row by row, in host byte order
+ */
+#ifndef MATVEC_READ_H
+#define MATVEC_READ_H
+
+#include <stdint.h>
+
+#define MATRIX_CACHE 1 //read or write the filename.mat cache
+
+#define MATRIX_MAGIC "FRACMAT1"
+
+struct MatrixCache{
+    char magic[8];        //MATRIX_MAGIC
+    uint32_t headerbytes; //sizeof(struct MatrixCache), where the doubles start
+    int32_t rows, cols;
+    uint32_t reserved;
+    uint64_t srcsize;     //the size of the text file the cache was made from
+    int64_t srcmtime;     //and its modification time, seconds
+    int64_t srcmtimensec; //and nanoseconds
+};
+
 double **matrix_read(char *filename, int *rows, int *cols);
+double *matrix_load(const char *filename, int *rows, int *cols, int flags);
+
+#endif
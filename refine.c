@@ -0,0 +1,392 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: refine.c
+ *
+ * This file contains the genetic algorithm of refine.h. Each
+ * generation keeps its elite, and fills the rest with children of
+ * parents picked by tournament on rank. A child takes each function
+ * from one of its parents (or is a copy of one) and is then mutated:
+ * some functions get gaussian steps in their parameters, and a
+ * matrix that stops being contractive is put back. The steps shrink
+ * geometrically over the generations.
+ *
+ * Individuals are ranked by their full resolution cost if they are
+ * survivors and by their coarse cost otherwise, survivors first.
+ * The chaos game of every individual is seeded the same way, so a
+ * genome always gets the same cost and can be looked up in the
+ * cache instead of being drawn. A generation is drawn by rc ->
+ * threads threads, each with its own fractals, which are reused.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "Fractals.h"
+#include "fracfuncs.h"
+#include "refine.h"
+
+#define COARSE 0
+#define FINE   1
+
+struct CacheEntry{
+    uint64_t key;         //hash of the genome and level, 0 if empty
+    double cost;
+    struct Score score;
+};
+
+struct Refinement{
+    /* The state of one refinegenome call */
+    const struct RefineConfig *rc;
+    struct FracConfig cfg[2];         //the coarse and the full resolution
+    const struct Bitmap *target[2];
+    int numfuncs, genelen, popsize, threads;
+    double *genes, *next;             //this generation and the next
+    double *cost[2];                  //the cost of each individual at each level
+    struct Score *score;              //and its full resolution score
+    struct CacheEntry *cache;
+    size_t cachemask;
+    int *jobs, numjobs, level;        //the individuals left to draw
+    atomic_int nextjob;
+    int quit;
+    pthread_barrier_t start, done;
+    struct Fractal **fracs;           //a coarse and a full fractal per thread
+};
+
+struct Helper{
+    struct Refinement *rf;
+    int thread;
+};
+
+void defaultrefineconfig(struct RefineConfig *rc, int numpoints){
+    /* This function fills in the default refinement of a genome that
+     * is drawn with numpoints points */
+    rc -> popsize      = 32;
+    rc -> generations  = 40;
+    rc -> elite        = 2;
+    rc -> survivors    = 4;
+    rc -> coarsefactor = 4;
+    rc -> coarsepoints = (numpoints/16 > 1000) ? numpoints/16 : 1000;
+    rc -> sigma        = 0.05;
+    rc -> threads      = 1;
+    rc -> seed         = 0;
+}
+
+void defaultprobs(int numfuncs, const double *params, double *probs){
+    /* This function sets the probabilities of a genome to the
+     * normalized spectral radii, or equal if a function is not
+     * contractive, as makefracgenome does when given none */
+    int i;
+    double sum = 0;
+    for (i = 0; i < numfuncs; i++){
+        probs[i] = validatefunc(params[4*i], params[4*i+1], params[4*i+2], params[4*i+3]);
+        if (probs[i] <= 0) break;
+        sum += probs[i];
+    }
+    for (int j = 0; j < numfuncs; j++) probs[j] = (i == numfuncs) ? probs[j]/sum : 1.0/numfuncs;
+}
+
+static uint64_t hashgenes(const double *g, int len, int level){
+    /* This function hashes the bits of a genome at a level, never to 0 */
+    uint64_t h = 0x9E3779B97F4A7C15ULL * (uint64_t)(level + 1), bits;
+    for (int i = 0; i < len; i++){
+        memcpy(&bits, g + i, sizeof(bits));
+        h = (h ^ bits) * 0xBF58476D1CE4E5B9ULL;
+        h ^= h >> 31;
+    }
+    return (h == 0) ? 1 : h;
+}
+
+static struct CacheEntry *cacheslot(struct Refinement *rf, uint64_t key){
+    /* This function finds the entry of key, or the empty one it goes in */
+    size_t i = key & rf -> cachemask;
+    while (rf -> cache[i].key != 0 && rf -> cache[i].key != key) i = (i + 1) & rf -> cachemask;
+    return &rf -> cache[i];
+}
+
+static double gaussian(struct Rand *rng){
+    /* This function returns a standard normal number (Box-Muller) */
+    double u = 1 - randdouble(rng), v = randdouble(rng);
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static void normalizeprobs(double *probs, int n){
+    double sum = 0;
+    for (int i = 0; i < n; i++) sum += probs[i];
+    for (int i = 0; i < n; i++) probs[i] /= sum;
+}
+
+static void mutate(struct Refinement *rf, struct Rand *rng, double *g, double sigma){
+    /* This function mutates a genome: one function, and each other
+     * one with probability 1/numfuncs, gets gaussian steps of size
+     * sigma, and sometimes a probability is scaled */
+    int n = rf -> numfuncs, i, j, k = randint(rng, n);
+    double old[4];
+    for (i = 0; i < n; i++){
+        if (i != k && randint(rng, n) != 0) continue;
+        double *m = g + 4*i, *t = g + 4*n + 2*i;
+        memcpy(old, m, sizeof(old));
+        for (j = 0; j < 4; j++) m[j] += sigma * gaussian(rng);
+        if (validatefunc(m[0], m[1], m[2], m[3]) <= 0) memcpy(m, old, sizeof(old));
+        t[0] += sigma * gaussian(rng);
+        t[1] += sigma * gaussian(rng);
+    }
+    if (randint(rng, 4) == 0){
+        g[6*n + randint(rng, n)] *= exp(4 * sigma * gaussian(rng));
+        normalizeprobs(g + 6*n, n);
+    }
+}
+
+static void crossover(struct Refinement *rf, struct Rand *rng, double *child, const double *a, const double *b){
+    /* This function gives the child each function of parent a or b */
+    int n = rf -> numfuncs;
+    for (int i = 0; i < n; i++){
+        const double *p = (randint(rng, 2) == 0) ? a : b;
+        memcpy(child + 4*i, p + 4*i, 4 * sizeof(double));
+        memcpy(child + 4*n + 2*i, p + 4*n + 2*i, 2 * sizeof(double));
+        child[6*n + i] = p[6*n + i];
+    }
+    normalizeprobs(child + 6*n, n);
+}
+
+static void runjobs(struct Refinement *rf, int thread){
+    /* This function draws and scores individuals until none are left */
+    int j, n = rf -> numfuncs, level = rf -> level;
+    struct Fractal **frac = &rf -> fracs[2*thread + level];
+    struct Score s;
+    while ((j = atomic_fetch_add_explicit(&rf -> nextjob, 1, memory_order_relaxed)) < rf -> numjobs){
+        int i = rf -> jobs[j];
+        const double *g = rf -> genes + (size_t)i * rf -> genelen;
+        if (*frac == NULL) *frac = makefracgenome(&rf -> cfg[level], g, g + 6*n, rf -> rc -> seed);
+        else remakefracgenome(*frac, &rf -> cfg[level], g, g + 6*n, rf -> rc -> seed);
+        scorebitmaps(&(*frac) -> bm, rf -> target[level], &s);
+        rf -> cost[level][i] = s.chamfer + 1 - s.iou;
+        if (level == FINE) rf -> score[i] = s;
+    }
+}
+
+static void *refineworker(void *arg){
+    /* This function is run by the helper threads of a refinement */
+    struct Helper *h = (struct Helper *)arg;
+    struct Refinement *rf = h -> rf;
+    for (;;){
+        pthread_barrier_wait(&rf -> start);
+        if (rf -> quit) break;
+        runjobs(rf, h -> thread);
+        pthread_barrier_wait(&rf -> done);
+    }
+    return NULL;
+}
+
+static void evaluate(struct Refinement *rf, struct RefineResult *result, int level, const int *which, int count){
+    /* This function finds the costs of the individuals in which at a
+     * level, from the cache or by drawing them on all threads */
+    int k, i;
+    rf -> numjobs = 0;
+    for (k = 0; k < count; k++){
+        i = which[k];
+        struct CacheEntry *e = cacheslot(rf, hashgenes(rf -> genes + (size_t)i * rf -> genelen, rf -> genelen, level));
+        if (e -> key == 0){
+            rf -> jobs[rf -> numjobs++] = i;
+            continue;
+        }
+        rf -> cost[level][i] = e -> cost;
+        if (level == FINE) rf -> score[i] = e -> score;
+        result -> cachehits++;
+    }
+    rf -> level = level;
+    atomic_store_explicit(&rf -> nextjob, 0, memory_order_relaxed);
+    if (rf -> threads > 1){
+        pthread_barrier_wait(&rf -> start);
+        runjobs(rf, 0);
+        pthread_barrier_wait(&rf -> done);
+    }
+    else runjobs(rf, 0);
+    result -> renders += rf -> numjobs;
+    for (k = 0; k < rf -> numjobs; k++){
+        i = rf -> jobs[k];
+        uint64_t key = hashgenes(rf -> genes + (size_t)i * rf -> genelen, rf -> genelen, level);
+        struct CacheEntry *e = cacheslot(rf, key);
+        e -> key  = key;
+        e -> cost = rf -> cost[level][i];
+        if (level == FINE) e -> score = rf -> score[i];
+    }
+}
+
+static void sortbycost(int *order, const double *cost, int n){
+    /* This function sorts the first n individuals of order by cost */
+    for (int i = 1; i < n; i++){
+        int v = order[i], j = i;
+        while (j > 0 && cost[order[j - 1]] > cost[v]){
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = v;
+    }
+}
+
+void refinegenome(const struct RefineConfig *rc, struct FracConfig *cfg, const struct Bitmap *target,
+                  double *params, double *probs, struct RefineResult *result){
+    /* This function refines the genome params, probs of cfg -> numfuncs
+     * functions against the target bit map, which is drawn in cfg ->
+     * window, see refine.h. The best genome found replaces params and
+     * probs (it is never worse than the one given). The fractals are
+     * drawn at the size of the target with cfg -> numpoints points.
+     */
+    struct Refinement rf;
+    struct Bitmap small;
+    struct Rand rng;
+    struct Helper *helpers = NULL;
+    pthread_t *threads = NULL;
+    double *best, bestcost;
+    int *order, all0 = 0;
+    int i, gen, t, factor = rc -> coarsefactor;
+    size_t cachesize = 1;
+
+    memset(&rf, 0, sizeof(rf));
+    memset(result, 0, sizeof(struct RefineResult));
+    rf.rc       = rc;
+    rf.numfuncs = cfg -> numfuncs;
+    rf.genelen  = 7 * cfg -> numfuncs;
+    rf.popsize  = (rc -> popsize < 2) ? 2 : rc -> popsize;
+    int survivors = (rc -> survivors < 1) ? 1 : (rc -> survivors > rf.popsize) ? rf.popsize : rc -> survivors;
+    int elite = (rc -> elite < 0) ? 0 : (rc -> elite > survivors) ? survivors : rc -> elite;
+    rf.threads  = (rc -> threads < 1) ? 1 : rc -> threads;
+
+    /* The full and the coarse level. The coarse target has a pixel
+     * set wherever its block of the target has one */
+    while (factor > 1 && (target -> width % factor != 0 || target -> height % factor != 0)) factor--;
+    if (factor < 1) factor = 1;
+    rf.cfg[FINE]          = *cfg;
+    rf.cfg[FINE].width    = target -> width;
+    rf.cfg[FINE].height   = target -> height;
+    rf.cfg[FINE].stream   = 1;
+    rf.cfg[FINE].autofit  = 0;
+    rf.cfg[FINE].cutoff   = 0;
+    rf.cfg[FINE].pixtype  = PIX_BIT;
+    rf.cfg[FINE].supersample = 1;
+    rf.cfg[FINE].adaptwindow = 0;
+    rf.cfg[COARSE]           = rf.cfg[FINE];
+    rf.cfg[COARSE].width    /= factor;
+    rf.cfg[COARSE].height   /= factor;
+    rf.cfg[COARSE].numpoints = rc -> coarsepoints;
+    rf.target[FINE] = rf.target[COARSE] = target;
+    if (factor > 1){
+        bmalloc(&small, rf.cfg[COARSE].width, rf.cfg[COARSE].height, PIX_BIT, LAYOUT_ROWS);
+        bmdownsample(&small, target, factor);
+        rf.target[COARSE] = &small;
+    }
+
+    while (cachesize < 2 * (size_t)(rf.popsize + survivors) * (rc -> generations + 1)) cachesize *= 2;
+    rf.cachemask = cachesize - 1;
+    if ((rf.genes = (double *)malloc(2 * (size_t)rf.popsize * rf.genelen * sizeof(double))) == NULL ||
+        (rf.cost[COARSE] = (double *)malloc(2 * rf.popsize * sizeof(double))) == NULL ||
+        (rf.score = (struct Score *)malloc(rf.popsize * sizeof(struct Score))) == NULL ||
+        (rf.jobs = (int *)malloc(2 * rf.popsize * sizeof(int))) == NULL ||
+        (best = (double *)malloc(rf.genelen * sizeof(double))) == NULL ||
+        (rf.cache = (struct CacheEntry *)calloc(cachesize, sizeof(struct CacheEntry))) == NULL ||
+        (rf.fracs = (struct Fractal **)calloc(2 * rf.threads, sizeof(struct Fractal *))) == NULL){
+        fprintf(stderr, "Malloc failed. (refinegenome)\n");
+        exit(1);
+    }
+    rf.next       = rf.genes + (size_t)rf.popsize * rf.genelen;
+    rf.cost[FINE] = rf.cost[COARSE] + rf.popsize;
+    order         = rf.jobs + rf.popsize;
+
+    if (rf.threads > 1){
+        pthread_barrier_init(&rf.start, NULL, rf.threads);
+        pthread_barrier_init(&rf.done, NULL, rf.threads);
+        if ((helpers = (struct Helper *)malloc(rf.threads * sizeof(struct Helper))) == NULL ||
+            (threads = (pthread_t *)malloc(rf.threads * sizeof(pthread_t))) == NULL){
+            fprintf(stderr, "Malloc failed. (refinegenome)\n");
+            exit(1);
+        }
+        for (t = 1; t < rf.threads; t++){
+            helpers[t].rf = &rf;
+            helpers[t].thread = t;
+            if (pthread_create(&threads[t], NULL, refineworker, &helpers[t]) != 0){
+                fprintf(stderr, "Failed to create refine thread %d\n", t);
+                exit(1);
+            }
+        }
+    }
+
+    /* Generation 0 is the genome given and mutations of it */
+    seedrand(&rng, ~rc -> seed);
+    memcpy(rf.genes, params, 6 * rf.numfuncs * sizeof(double));
+    memcpy(rf.genes + 6 * rf.numfuncs, probs, rf.numfuncs * sizeof(double));
+    normalizeprobs(rf.genes + 6 * rf.numfuncs, rf.numfuncs);
+    for (i = 1; i < rf.popsize; i++){
+        double *g = rf.genes + (size_t)i * rf.genelen;
+        memcpy(g, rf.genes, rf.genelen * sizeof(double));
+        mutate(&rf, &rng, g, rc -> sigma);
+    }
+    evaluate(&rf, result, FINE, &all0, 1);
+    result -> start = result -> best = rf.score[0];
+    bestcost = rf.cost[FINE][0];
+    memcpy(best, rf.genes, rf.genelen * sizeof(double));
+
+    for (gen = 0; gen < rc -> generations; gen++){
+        double sigma = rc -> sigma * pow(0.1, (rc -> generations > 1) ? gen/(double)(rc -> generations - 1) : 0);
+        for (i = 0; i < rf.popsize; i++){
+            order[i] = i;
+            rf.cost[FINE][i] = HUGE_VAL;
+        }
+        evaluate(&rf, result, COARSE, order, rf.popsize);
+        sortbycost(order, rf.cost[COARSE], rf.popsize);
+        evaluate(&rf, result, FINE, order, survivors);
+        sortbycost(order, rf.cost[FINE], survivors);
+        if (rf.cost[FINE][order[0]] < bestcost){
+            bestcost = rf.cost[FINE][order[0]];
+            result -> best = rf.score[order[0]];
+            memcpy(best, rf.genes + (size_t)order[0] * rf.genelen, rf.genelen * sizeof(double));
+        }
+        if (gen == rc -> generations - 1) break;
+
+        /* The next generation */
+        for (i = 0; i < rf.popsize; i++){
+            double *child = rf.next + (size_t)i * rf.genelen;
+            if (i < elite){
+                memcpy(child, rf.genes + (size_t)order[i] * rf.genelen, rf.genelen * sizeof(double));
+                continue;
+            }
+            int ra = randint(&rng, rf.popsize), rb = randint(&rng, rf.popsize);
+            const double *a = rf.genes + (size_t)order[(ra < rb) ? ra : rb] * rf.genelen;
+            ra = randint(&rng, rf.popsize);
+            rb = randint(&rng, rf.popsize);
+            const double *b = rf.genes + (size_t)order[(ra < rb) ? ra : rb] * rf.genelen;
+            if (randint(&rng, 2) == 0) crossover(&rf, &rng, child, a, b);
+            else memcpy(child, a, rf.genelen * sizeof(double));
+            mutate(&rf, &rng, child, sigma);
+        }
+        double *tmp = rf.genes;
+        rf.genes = rf.next;
+        rf.next  = tmp;
+    }
+    memcpy(params, best, 6 * rf.numfuncs * sizeof(double));
+    memcpy(probs, best + 6 * rf.numfuncs, rf.numfuncs * sizeof(double));
+
+    if (rf.threads > 1){
+        rf.quit = 1;
+        pthread_barrier_wait(&rf.start);
+        for (t = 1; t < rf.threads; t++) pthread_join(threads[t], NULL);
+        pthread_barrier_destroy(&rf.start);
+        pthread_barrier_destroy(&rf.done);
+        free(helpers);
+        free(threads);
+    }
+    for (t = 0; t < 2 * rf.threads; t++){
+        if (rf.fracs[t] != NULL) freefrac(rf.fracs[t]);
+    }
+    if (factor > 1) bmfree(&small);
+    free(rf.genes < rf.next ? rf.genes : rf.next);
+    free(rf.cost[COARSE]);
+    free(rf.score);
+    free(rf.jobs);
+    free(rf.cache);
+    free(rf.fracs);
+    free(best);
+}
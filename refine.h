@@ -0,0 +1,49 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: refine.h
+ *
+ * A genetic algorithm that refines a genome, eg. one predicted by a
+ * network, until its picture matches a target bit map. A genome is
+ * the 6 x numfuncs parameters of fracdata.dat followed by the
+ * numfuncs probabilities.
+ *
+ * The cost of a picture is its chamfer distance to the target plus
+ * 1 - IoU (see fracscore.h), so it is 0 for a perfect match. Every
+ * generation is first drawn at 1/coarsefactor of the resolution
+ * with coarsepoints points, and only the best survivors are drawn
+ * at full resolution. The costs are cached by a hash of the genome,
+ * so the elite and repeated children are not drawn again.
+ */
+#ifndef REFINE_H
+#define REFINE_H
+
+#include <stdint.h>
+#include "fracscore.h"
+
+struct FracConfig;
+
+struct RefineConfig{
+    int popsize;          //individuals in each generation
+    int generations;
+    int elite;            //the best individuals, carried over unchanged
+    int survivors;        //the best at the coarse level, drawn at full resolution
+    int coarsefactor;     //the coarse level is 1/coarsefactor of the resolution
+    int coarsepoints;     //and is drawn with this many points
+    double sigma;         //size of a mutation, shrinking to sigma/10 by the end
+    int threads;          //threads that draw each generation
+    uint64_t seed;        //seeds the mutations and the chaos game
+};
+
+struct RefineResult{
+    struct Score start;   //the score of the genome refinegenome was given
+    struct Score best;    //and of the genome it returned, at full resolution
+    int renders, cachehits;
+};
+
+void defaultrefineconfig(struct RefineConfig *rc, int numpoints);
+void defaultprobs(int numfuncs, const double *params, double *probs);
+void refinegenome(const struct RefineConfig *rc, struct FracConfig *cfg, const struct Bitmap *target,
+                  double *params, double *probs, struct RefineResult *result);
+
+#endif
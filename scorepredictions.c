@@ -0,0 +1,423 @@
+/*Created by:    Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: scorepredictions.c
+ *
+ * This is the main file that, when run, scores the genomes a
+ * network predicted against the fractals they were predicted from
+ *
+ * The predictions are a matrix with the columns of fracdata.dat
+ * (see generatedata.c): the fractal number, the number of
+ * functions, ... and from column 9 the IFS parameters, then
+ * optionally the probabilities, the spectral radii, the seed and
+ * the window. The genome of every row is drawn with makefracgenome
+ * and compared with its target, which is either
+ *
+ *      --targets DIR     the png DIR/frac%d.png of the fractal number
+ *      --reference FILE  the genome of the line of FILE (a
+ *                        fracdata.dat) with the same fractal number,
+ *                        drawn the same way as the prediction
+ *
+ * Both are drawn in the window of the reference line, or else of the
+ * prediction, or else [-8,8]x[-8,8], unless --window is given, and
+ * at the size of the target png or --resolution. Probability
+ * columns that are missing or do not add up to anything positive
+ * are replaced by the normalized spectral radii. The seed column
+ * (or else the fractal number) seeds the chaos game, which draws
+ * --points points (100000). --deterministic draws both pictures
+ * with the deterministic renderer (see ifsrender.c), so the scores
+ * are free of chaos game noise, and --simd runs the chaos game in
+ * simd lanes.
+ *
+ * With --collage a prediction is not drawn: its collage on the
+ * target, ie. the union of the images of the target under its
+ * functions, is scored instead (see collage.h). With --targets no
+ * chaos game is run at all.
+ *
+ * With --refine G every prediction is first refined against its
+ * target for G generations of the genetic algorithm in refine.c,
+ * with --population N individuals (32), and scored after. --refined
+ * FILE gets the predictions with their refined genomes, in the
+ * columns they came in, so they can be scored or refined again.
+ *
+ * The rows are shared out to --threads workers (all cores by
+ * default). When refining and there are fewer rows than threads,
+ * the threads left over help draw each row's generations.
+ * --out FILE gets a line per scored prediction:
+ *
+ *      fracnum  iou  precision  recall  chamfer  hausdorff
+ *      predicted pixels  target pixels
+ *
+ * (see fracscore.h) and the means are written to stdout, with the
+ * means before refining if --refine is given.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include "Fractals.h"
+#include "PNGio.h"
+#include "fracfuncs.h"
+#include "fracscore.h"
+#include "matvec_read.h"
+#include "refine.h"
+#include "collage.h"
+
+#define DEFAULTPOINTS 100000
+
+struct Options{
+    int numthreads, windowgiven, collage;
+    int generations, popsize;   //of the refinement, if generations > 0
+    char *predfile, *targetdir, *reffile, *outfile, *refinedfile;
+    struct FracConfig cfg;
+    struct RefineConfig rc;
+};
+
+struct Pool{
+    struct Options *opt;
+    double *pred, *ref;
+    int predrows, predcols, refrows, refcols;
+    int *refindex;         //the line of ref of each fractal number, or -1
+    int maxfracnum;
+    struct Score *scores;
+    struct Score *starts;  //the scores before refining
+    double **refined;      //the refined genome of each row, 7 x numfuncs
+    int *scored;           //0 if the target of the row could not be found
+    atomic_int next;       //next row to be claimed by a worker
+};
+
+struct Genome{
+    /* The genome of a line of fracdata.dat, pointing into the line */
+    int numfuncs, fracnum;
+    const double *params, *probs;
+    double window[4];
+    int haswindow;
+    uint64_t seed;
+};
+
+static int readgenome(const double *row, int cols, struct Genome *g){
+    /* This function finds the genome of a fracdata.dat line. It
+     * returns -1 if the line is too short for its number of functions
+     */
+    int n = (int)row[1], i;
+    double sum = 0;
+    if (n < 1 || 9 + 6*n > cols) return -1;
+    g -> numfuncs = n;
+    g -> fracnum  = (int)row[0];
+    g -> params   = row + 9;
+    g -> probs    = NULL;
+    if (9 + 7*n <= cols){
+        for (i = 0; i < n && row[9 + 6*n + i] >= 0; i++) sum += row[9 + 6*n + i];
+        if (i == n && sum > 0) g -> probs = row + 9 + 6*n;
+    }
+    g -> seed = (9 + 8*n < cols) ? (uint64_t)row[9 + 8*n] : (uint64_t)g -> fracnum;
+    g -> haswindow = (9 + 8*n + 5 <= cols && row[9 + 8*n + 2] > row[9 + 8*n + 1] && row[9 + 8*n + 4] > row[9 + 8*n + 3]);
+    if (g -> haswindow) memcpy(g -> window, row + 9 + 8*n + 1, 4 * sizeof(double));
+    return 0;
+}
+
+static void drawgenome(struct Fractal **frac, struct FracConfig *cfg, struct Genome *g){
+    /* This function draws a genome in the worker's fractal, which is
+     * made on first use and reused after that */
+    cfg -> numfuncs = g -> numfuncs;
+    if (*frac == NULL) *frac = makefracgenome(cfg, g -> params, g -> probs, g -> seed);
+    else remakefracgenome(*frac, cfg, g -> params, g -> probs, g -> seed);
+}
+
+static void *worker(void *arg){
+    /* This function is run by each worker thread. It claims rows of
+     * the predictions until there are none left, draws them and their
+     * targets and scores them
+     */
+    struct Pool *pool = (struct Pool *)arg;
+    struct Options *opt = pool -> opt;
+    struct FracConfig cfg = opt -> cfg;
+    struct Fractal *pred = NULL, *target = NULL;
+    struct Bitmap png;
+    struct Genome pg, tg;
+    const struct Bitmap *tbm;
+    char pngname[4200];
+    int i;
+    memset(&png, 0, sizeof(png));
+    while ((i = atomic_fetch_add_explicit(&pool -> next, 1, memory_order_relaxed)) < pool -> predrows){
+        pool -> scored[i] = 0;
+        if (readgenome(pool -> pred + (size_t)i * pool -> predcols, pool -> predcols, &pg) != 0) continue;
+        if (!opt -> windowgiven){
+            if (pg.haswindow) memcpy(cfg.window, pg.window, 4 * sizeof(double));
+            else memcpy(cfg.window, opt -> cfg.window, 4 * sizeof(double));
+        }
+        if (opt -> targetdir != NULL){
+            snprintf(pngname, sizeof(pngname), "%s/frac%d.png", opt -> targetdir, pg.fracnum);
+            if (ReadPNGmask(pngname, &png) != 0) continue;
+            cfg.width  = png.width;
+            cfg.height = png.height;
+            tbm = &png;
+        }
+        else {
+            int r = (pg.fracnum >= 0 && pg.fracnum <= pool -> maxfracnum) ? pool -> refindex[pg.fracnum] : -1;
+            if (r < 0 || readgenome(pool -> ref + (size_t)r * pool -> refcols, pool -> refcols, &tg) != 0) continue;
+            if (!opt -> windowgiven && tg.haswindow) memcpy(cfg.window, tg.window, 4 * sizeof(double));
+            drawgenome(&target, &cfg, &tg);
+            tbm = &target -> bm;
+        }
+        if (opt -> generations > 0){
+            struct RefineConfig rc = opt -> rc;
+            struct RefineResult result;
+            double *g;
+            if ((g = pool -> refined[i] = (double *)malloc(7 * pg.numfuncs * sizeof(double))) == NULL){
+                fprintf(stderr, "Malloc failed. (scorepredictions)\n");
+                exit(1);
+            }
+            memcpy(g, pg.params, 6 * pg.numfuncs * sizeof(double));
+            if (pg.probs != NULL) memcpy(g + 6 * pg.numfuncs, pg.probs, pg.numfuncs * sizeof(double));
+            else defaultprobs(pg.numfuncs, pg.params, g + 6 * pg.numfuncs);
+            rc.seed = pg.seed;
+            cfg.numfuncs = pg.numfuncs;
+            refinegenome(&rc, &cfg, tbm, g, g + 6 * pg.numfuncs, &result);
+            pool -> starts[i] = result.start;
+            pool -> scores[i] = result.best;
+            pool -> scored[i] = 1;
+            continue;
+        }
+        if (opt -> collage){
+            collagescore(pg.params, pg.numfuncs, cfg.window, tbm, &pool -> scores[i]);
+            pool -> scored[i] = 1;
+            continue;
+        }
+        drawgenome(&pred, &cfg, &pg);
+        scorebitmaps(&pred -> bm, tbm, &pool -> scores[i]);
+        pool -> scored[i] = 1;
+    }
+    if (pred != NULL) freefrac(pred);
+    if (target != NULL) freefrac(target);
+    bmfree(&png);
+    return NULL;
+}
+
+static void usage(void){
+    fprintf(stderr, "Usage: scorepredictions --predictions FILE (--targets DIR | --reference FILE) [--out FILE]\n"
+                    "       [--threads N] [--points N] [--window MINX,MAXX,MINY,MAXY] [--resolution WIDTH HEIGHT]\n"
+                    "       [--deterministic] [--simd] [--refine GENERATIONS] [--population N] [--refined FILE]\n"
+                    "       [--collage]\n");
+    exit(1);
+}
+
+static void parseargs(int argc, char **argv, struct Options *opt){
+    /* This function sets the options in argv, which holds only options */
+    int i;
+    for (i = 0; i < argc; i++){
+        if (strcmp(argv[i], "--predictions") == 0 && i + 1 < argc){
+            opt -> predfile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--targets") == 0 && i + 1 < argc){
+            opt -> targetdir = argv[++i];
+        }
+        else if (strcmp(argv[i], "--reference") == 0 && i + 1 < argc){
+            opt -> reffile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc){
+            opt -> outfile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc){
+            opt -> numthreads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--points") == 0 && i + 1 < argc){
+            opt -> cfg.numpoints = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc){
+            double *w = opt -> cfg.window;
+            if (sscanf(argv[++i], "%lf,%lf,%lf,%lf", &w[0], &w[1], &w[2], &w[3]) != 4 || w[0] >= w[1] || w[2] >= w[3]){
+                fprintf(stderr, "The window should be MINX,MAXX,MINY,MAXY, eg. -8,8,-8,8\n");
+                exit(1);
+            }
+            opt -> windowgiven = 1;
+        }
+        else if (strcmp(argv[i], "--resolution") == 0 && i + 2 < argc){
+            opt -> cfg.width  = atoi(argv[++i]);
+            opt -> cfg.height = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--refine") == 0 && i + 1 < argc){
+            opt -> generations = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--population") == 0 && i + 1 < argc){
+            opt -> popsize = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--refined") == 0 && i + 1 < argc){
+            opt -> refinedfile = argv[++i];
+        }
+        else if (strcmp(argv[i], "--collage") == 0){
+            opt -> collage = 1;
+        }
+        else if (strcmp(argv[i], "--deterministic") == 0){
+            opt -> cfg.engine = ENGINE_IFS;
+        }
+        else if (strcmp(argv[i], "--simd") == 0){
+            opt -> cfg.engine = ENGINE_SIMD;
+        }
+        else {
+            fprintf(stderr, "Unknown option %s\n", argv[i]);
+            usage();
+        }
+    }
+}
+
+int main(int argc, char *argv[]){
+    struct Options opt;
+    struct Pool pool;
+    pthread_t *threads;
+    struct timespec start, end;
+    double sums[5] = {0, 0, 0, 0, 0}, startsums[2] = {0, 0};
+    int i, j, numscored = 0, numworkers;
+    FILE *out = NULL;
+
+    memset(&opt, 0, sizeof(opt));
+    defaultconfig(&opt.cfg, 0, DEFAULTPOINTS);
+    opt.cfg.stream = 1;
+    opt.numthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    parseargs(argc - 1, argv + 1, &opt);
+    if (opt.numthreads < 1) opt.numthreads = 1;
+    if (opt.predfile == NULL || (opt.targetdir == NULL) == (opt.reffile == NULL)) usage();
+    if (opt.cfg.numpoints < 1){
+        fprintf(stderr, "The number of points must be positive\n");
+        exit(1);
+    }
+    if (opt.cfg.width < 8 || opt.cfg.height < 8){
+        fprintf(stderr, "The resolution must be at least 8 x 8\n");
+        exit(1);
+    }
+    defaultrefineconfig(&opt.rc, opt.cfg.numpoints);
+    opt.rc.generations = opt.generations;
+    if (opt.popsize > 0) opt.rc.popsize = opt.popsize;
+    if (opt.collage && opt.generations > 0){
+        fprintf(stderr, "--collage can not be used with --refine\n");
+        exit(1);
+    }
+    if (opt.refinedfile != NULL && opt.generations < 1){
+        fprintf(stderr, "--refined needs --refine\n");
+        exit(1);
+    }
+
+    memset(&pool, 0, sizeof(pool));
+    pool.opt = &opt;
+    if ((pool.pred = matrix_load(opt.predfile, &pool.predrows, &pool.predcols, 0)) == NULL) exit(1);
+    if (opt.reffile != NULL){
+        /* Index the reference lines by fractal number */
+        if ((pool.ref = matrix_load(opt.reffile, &pool.refrows, &pool.refcols, 0)) == NULL) exit(1);
+        pool.maxfracnum = -1;
+        for (i = 0; i < pool.refrows; i++){
+            int f = (int)pool.ref[(size_t)i * pool.refcols];
+            if (f > pool.maxfracnum) pool.maxfracnum = f;
+        }
+        if ((pool.refindex = (int *)malloc((pool.maxfracnum + 1) * sizeof(int))) == NULL){
+            fprintf(stderr, "Malloc failed. (scorepredictions)\n");
+            exit(1);
+        }
+        for (i = 0; i <= pool.maxfracnum; i++) pool.refindex[i] = -1;
+        for (i = 0; i < pool.refrows; i++){
+            int f = (int)pool.ref[(size_t)i * pool.refcols];
+            if (f >= 0) pool.refindex[f] = i;
+        }
+    }
+    numworkers = opt.numthreads;
+    if (opt.generations > 0 && pool.predrows < numworkers){
+        numworkers = (pool.predrows > 0) ? pool.predrows : 1;
+        opt.rc.threads = opt.numthreads/numworkers;
+    }
+    if ((pool.scores = (struct Score *)malloc(pool.predrows * sizeof(struct Score))) == NULL ||
+        (pool.starts = (struct Score *)malloc(pool.predrows * sizeof(struct Score))) == NULL ||
+        (pool.refined = (double **)calloc(pool.predrows, sizeof(double *))) == NULL ||
+        (pool.scored = (int *)malloc(pool.predrows * sizeof(int))) == NULL ||
+        (threads = (pthread_t *)malloc(opt.numthreads * sizeof(pthread_t))) == NULL){
+        fprintf(stderr, "Malloc failed. (scorepredictions)\n");
+        exit(1);
+    }
+    atomic_init(&pool.next, 0);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < numworkers; i++){
+        if (pthread_create(&threads[i], NULL, worker, &pool) != 0){
+            fprintf(stderr, "Failed to create worker thread %d\n", i);
+            exit(1);
+        }
+    }
+    for (i = 0; i < numworkers; i++){
+        pthread_join(threads[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (opt.outfile != NULL && (out = fopen(opt.outfile, "w")) == NULL){
+        fprintf(stderr, "Failed to open file %s\n", opt.outfile);
+        exit(1);
+    }
+    for (i = 0; i < pool.predrows; i++){
+        struct Score *s = &pool.scores[i];
+        if (!pool.scored[i]) continue;
+        numscored++;
+        sums[0] += s -> iou;
+        sums[1] += s -> precision;
+        sums[2] += s -> recall;
+        sums[3] += s -> chamfer;
+        sums[4] += s -> hausdorff;
+        startsums[0] += pool.starts[i].iou;
+        startsums[1] += pool.starts[i].chamfer;
+        if (out != NULL){
+            fprintf(out, "%d\t%.6lf\t%.6lf\t%.6lf\t%.6lf\t%.6lf\t%ld\t%ld\n", (int)pool.pred[(size_t)i * pool.predcols],
+                    s -> iou, s -> precision, s -> recall, s -> chamfer, s -> hausdorff, s -> predpixels, s -> targetpixels);
+        }
+    }
+    if (out != NULL) fclose(out);
+    if (opt.refinedfile != NULL){
+        /* The predictions with their refined genomes */
+        if ((out = fopen(opt.refinedfile, "w")) == NULL){
+            fprintf(stderr, "Failed to open file %s\n", opt.refinedfile);
+            exit(1);
+        }
+        for (i = 0; i < pool.predrows; i++){
+            double *row = pool.pred + (size_t)i * pool.predcols;
+            int n = (int)row[1];
+            if (pool.refined[i] != NULL){
+                memcpy(row + 9, pool.refined[i], ((9 + 7*n <= pool.predcols) ? 7*n : 6*n) * sizeof(double));
+                for (j = 0; j < n && 9 + 7*n + j < pool.predcols; j++){
+                    double *m = pool.refined[i] + 4*j;
+                    row[9 + 7*n + j] = validatefunc(m[0], m[1], m[2], m[3]);
+                }
+            }
+            for (j = 0; j < pool.predcols; j++){
+                if (j < 4) fprintf(out, "%d", (int)row[j]);
+                else if (n >= 1 && j == 9 + 8*n) fprintf(out, "%llu", (unsigned long long)row[j]);
+                else fprintf(out, "%.15lf", row[j]);
+                fputc((j + 1 < pool.predcols) ? '\t' : '\n', out);
+            }
+        }
+        fclose(out);
+    }
+    if (numscored < pool.predrows){
+        fprintf(stderr, "%d predictions had no target (or too few columns) and were not scored\n", pool.predrows - numscored);
+    }
+    fprintf(stdout, "Scored %d predictions in %.2lf s\n", numscored,
+            (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9);
+    if (numscored > 0 && opt.generations > 0){
+        fprintf(stdout, "Mean iou before refining:     %.6lf\n", startsums[0]/numscored);
+        fprintf(stdout, "Mean chamfer before refining: %.6lf\n", startsums[1]/numscored);
+    }
+    if (numscored > 0){
+        fprintf(stdout, "Mean iou:       %.6lf\n", sums[0]/numscored);
+        fprintf(stdout, "Mean precision: %.6lf\n", sums[1]/numscored);
+        fprintf(stdout, "Mean recall:    %.6lf\n", sums[2]/numscored);
+        fprintf(stdout, "Mean chamfer:   %.6lf\n", sums[3]/numscored);
+        fprintf(stdout, "Mean hausdorff: %.6lf\n", sums[4]/numscored);
+    }
+    free(pool.pred);
+    free(pool.ref);
+    free(pool.refindex);
+    for (i = 0; i < pool.predrows; i++) free(pool.refined[i]);
+    free(pool.refined);
+    free(pool.starts);
+    free(pool.scores);
+    free(pool.scored);
+    free(threads);
+    exit(0);
+}
@@ -0,0 +1,231 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: shardio.c
+ *
+ * This file contains the functions used to write fractals
+ * to the binary shard format described in shardio.h
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "Fractals.h"
+#include "shardio.h"
+
+_Static_assert(sizeof(struct ShardHeader) == SHARDHEADER, "shard header must be SHARDHEADER bytes");
+
+int shardnumlabels(int numfuncs){
+    /* This function returns the number of float32 labels in a record */
+    return 9 + 8 * numfuncs + 7;
+}
+
+static size_t shardimagesize(int width, int height, int imagetype){
+    /* This function returns the size of an image in a record, without padding */
+    if (imagetype == SHARD_BITS) return (size_t)((width + 7)/8) * height;
+    return (size_t)width * height;
+}
+
+size_t shardrecordsize(int numfuncs, int width, int height, int imagetype){
+    /* This function returns the size of a record, padded to 8 bytes */
+    size_t size = 16 + 4 * shardnumlabels(numfuncs) + shardimagesize(width, height, imagetype);
+    return (size + 7) & ~(size_t)7;
+}
+
+static void packimage(struct Bitmap *bm, int imagetype, unsigned char *image){
+    /* This function writes a pixel map into the image of a record */
+    int x, y;
+    if (imagetype == SHARD_BITS){
+        int rowbytes = (bm -> width + 7)/8;
+        memset(image, 0, (size_t)rowbytes * bm -> height);
+        for (y = 0; y < bm -> height; y++){
+            unsigned char *row = image + (size_t)y * rowbytes;
+            if (bm -> pixtype == PIX_BIT){
+                /* Copy a byte at a time, flipping the bit order */
+                const uint64_t *words = (const uint64_t *)bm -> data + (size_t)y * bm -> stride;
+                for (x = 0; x < rowbytes; x++){
+                    unsigned char b = (unsigned char)(words[x >> 3] >> (8 * (x & 7)));
+                    b = (unsigned char)(((b * 0x0802LU & 0x22110LU) | (b * 0x8020LU & 0x88440LU)) * 0x10101LU >> 16);
+                    row[x] = b;
+                }
+                if (bm -> width & 7) row[rowbytes-1] &= (unsigned char)(0xff << (8 - (bm -> width & 7)));
+            }
+            else {
+                for (x = 0; x < bm -> width; x++){
+                    if (bmget(bm, x, y) != 0) row[x >> 3] |= (unsigned char)(0x80 >> (x & 7));
+                }
+            }
+        }
+    }
+    else {
+        for (y = 0; y < bm -> height; y++){
+            for (x = 0; x < bm -> width; x++){
+                uint32_t v = bmget(bm, x, y);
+                image[(size_t)y * bm -> width + x] = (unsigned char)(v > 255 ? 255 : v);
+            }
+        }
+    }
+}
+
+void shardrecord(struct Fractal *frac, int imagetype, unsigned char *record, size_t size){
+    /* This function writes the record of a fractal into record,
+     * which must be shardrecordsize() bytes long
+     */
+    int j, n = frac -> numfuncs;
+    uint64_t seed = frac -> seed;
+    int32_t head[2] = {frac -> fracnum, frac -> converged ? 0 : SHARD_UNCONVERGED};
+    float *labels = (float *)(record + 16);
+    memset(record, 0, size);
+    memcpy(record, &seed, 8);
+    memcpy(record + 8, head, 8);
+    labels[0] = (float)frac -> fracnum;
+    labels[1] = (float)frac -> numfuncs;
+    labels[2] = (float)frac -> pointsused;
+    labels[3] = (float)frac -> numb;
+    labels[4] = (float)frac -> avgx;
+    labels[5] = (float)frac -> avgy;
+    labels[6] = (float)frac -> stddevx;
+    labels[7] = (float)frac -> stddevy;
+    labels[8] = (float)frac -> dimension;
+    labels += 9;
+    for (j = 0; j < 4*n; j++) *labels++ = (float)frac -> genome[0][j];
+    for (j = 0; j < 2*n; j++) *labels++ = (float)frac -> genome[1][j];
+    for (j = 0; j < n; j++)   *labels++ = (float)frac -> genome[2][j];
+    for (j = 0; j < n; j++)   *labels++ = (float)frac -> genome[3][j];
+    for (j = 0; j < 4; j++)   *labels++ = (float)frac -> window[j];
+    *labels++ = (float)frac -> covxy;
+    *labels++ = (float)frac -> orientation;
+    *labels++ = (float)frac -> corrdim;
+    packimage(&frac -> bm, imagetype, record + 16 + 4 * shardnumlabels(n));
+}
+
+static void writeheader(struct ShardWriter *w){
+    /* This function flushes the records of a shard to the file and
+     * writes its header over the one at the start
+     */
+    if (fflush(w -> fp) != 0 || pwrite(fileno(w -> fp), &w -> header, SHARDHEADER, 0) != SHARDHEADER){
+        fprintf(stderr, "Failed to write shard header\n");
+        exit(1);
+    }
+}
+
+static void setheader(struct ShardHeader *h, int numfuncs, int width, int height, int imagetype, int firstfracnum){
+    /* This function fills in the header of a shard with no samples */
+    memset(h, 0, sizeof(struct ShardHeader));
+    memcpy(h -> magic, SHARDMAGIC, 8);
+    h -> version      = SHARDVERSION;
+    h -> headerbytes  = SHARDHEADER;
+    h -> firstfracnum = firstfracnum;
+    h -> width        = width;
+    h -> height       = height;
+    h -> imagetype    = imagetype;
+    h -> numfuncs     = numfuncs;
+    h -> numlabels    = shardnumlabels(numfuncs);
+    h -> imagebytes   = shardimagesize(width, height, imagetype);
+    h -> recordbytes  = shardrecordsize(numfuncs, width, height, imagetype);
+}
+
+static void growoffsets(struct ShardWriter *w, int n){
+    /* This function makes room for the offsets of n records */
+    if (n <= w -> capacity) return;
+    while (w -> capacity < n) w -> capacity = (w -> capacity == 0) ? 1024 : 2 * w -> capacity;
+    if ((w -> offsets = (uint64_t *)realloc(w -> offsets, w -> capacity * sizeof(uint64_t))) == NULL){
+        fprintf(stderr, "Malloc failed. (shardappend)\n");
+        exit(1);
+    }
+}
+
+struct ShardWriter * shardopen(char *filename, int numfuncs, int width, int height, int imagetype, int firstfracnum){
+    /* This function creates a shard file and writes a header with no
+     * samples in it. The header is completed by shardclose
+     */
+    struct ShardWriter *w;
+    if ((w = (struct ShardWriter *)calloc(1, sizeof(struct ShardWriter))) == NULL){
+        fprintf(stderr, "Malloc failed. (shardopen)\n");
+        exit(1);
+    }
+    if ((w -> fp = fopen(filename, "wb")) == NULL){
+        fprintf(stderr, "Failed to open file (shardopen): %s\n", filename);
+        exit(1);
+    }
+    setheader(&w -> header, numfuncs, width, height, imagetype, firstfracnum);
+    if (fwrite(&w -> header, SHARDHEADER, 1, w -> fp) != 1){
+        fprintf(stderr, "Failed to write shard header\n");
+        exit(1);
+    }
+    return w;
+}
+
+struct ShardWriter * shardresume(char *filename, int numfuncs, int width, int height, int imagetype,
+                                 int firstfracnum, int numsamples){
+    /* This function reopens a shard left by an earlier run to append
+     * to it after its first numsamples records, which are the ones
+     * committed. Any records past them and the index are cut off. It
+     * returns NULL if the file is missing, is a shard of other
+     * fractals or holds fewer than numsamples records
+     */
+    struct ShardWriter *w;
+    struct ShardHeader disk, want;
+    uint64_t end;
+    FILE *fp = fopen(filename, "r+b");
+    if (fp == NULL) return NULL;
+    setheader(&want, numfuncs, width, height, imagetype, firstfracnum);
+    if (fread(&disk, SHARDHEADER, 1, fp) != 1 || memcmp(disk.magic, SHARDMAGIC, 8) != 0
+        || disk.firstfracnum != want.firstfracnum || disk.width != want.width || disk.height != want.height
+        || disk.imagetype != want.imagetype || disk.numfuncs != want.numfuncs
+        || disk.recordbytes != want.recordbytes || disk.numsamples < (uint32_t)numsamples){
+        fclose(fp);
+        return NULL;
+    }
+    end = SHARDHEADER + (uint64_t)numsamples * want.recordbytes;
+    if (fflush(fp) != 0 || ftruncate(fileno(fp), (off_t)end) != 0 || fseeko(fp, (off_t)end, SEEK_SET) != 0){
+        fprintf(stderr, "Failed to truncate file (shardresume): %s\n", filename);
+        exit(1);
+    }
+    if ((w = (struct ShardWriter *)calloc(1, sizeof(struct ShardWriter))) == NULL){
+        fprintf(stderr, "Malloc failed. (shardresume)\n");
+        exit(1);
+    }
+    w -> fp = fp;
+    w -> header = want;
+    w -> header.numsamples = numsamples;
+    growoffsets(w, numsamples);
+    for (int i = 0; i < numsamples; i++) w -> offsets[i] = SHARDHEADER + (uint64_t)i * want.recordbytes;
+    writeheader(w);
+    return w;
+}
+
+void shardappend(struct ShardWriter *w, unsigned char *record){
+    /* This function adds a record made by shardrecord to the shard
+     * and counts it in the header on disk
+     */
+    struct ShardHeader *h = &w -> header;
+    growoffsets(w, h -> numsamples + 1);
+    w -> offsets[h -> numsamples] = SHARDHEADER + h -> numsamples * h -> recordbytes;
+    if (fwrite(record, h -> recordbytes, 1, w -> fp) != 1){
+        fprintf(stderr, "Failed to write shard record\n");
+        exit(1);
+    }
+    h -> numsamples += 1;
+    writeheader(w);
+}
+
+void shardclose(struct ShardWriter *w){
+    /* This function writes the index of a shard, fills in the header
+     * and closes the file
+     */
+    struct ShardHeader *h = &w -> header;
+    h -> indexoffset = SHARDHEADER + h -> numsamples * h -> recordbytes;
+    if (fwrite(w -> offsets, sizeof(uint64_t), h -> numsamples, w -> fp) != h -> numsamples){
+        fprintf(stderr, "Failed to write shard index\n");
+        exit(1);
+    }
+    writeheader(w);
+    if (fclose(w -> fp) != 0){
+        fprintf(stderr, "Failed to close shard file\n");
+        exit(1);
+    }
+    free(w -> offsets);
+    free(w);
+}
@@ -0,0 +1,81 @@
+/*Created by:  Liam Graham
+ * Last updated: Oct. 2026
+ *
+ * FILE NAME: shardio.h
+ *
+ * A binary dataset format that can be memory mapped. A shard
+ * file holds a run of consecutive fractals:
+ *
+ *      header      SHARDHEADER bytes, see struct ShardHeader
+ *      records     numsamples records of recordbytes bytes each
+ *      index       numsamples uint64 offsets of the records
+ *
+ * and each record is
+ *
+ *      uint64      seed
+ *      int32       fractal number
+ *      int32       flags, SHARD_UNCONVERGED if the deterministic
+ *                  renderer gave up before the picture settled (see
+ *                  ifsrender.c), otherwise 0
+ *      float32     numlabels labels: the fracdata.dat columns without
+ *                  the seed, ie. fracnum, numfuncs, numpoints, numb,
+ *                  avgx, avgy, stddevx, stddevy, dimension, genome,
+ *                  window, covxy, orientation, corrdim
+ *      uint8       the image, imagebytes bytes, padded to 8 bytes
+ *
+ * Images are either SHARD_BITS, rows of (width+7)/8 bytes with the
+ * leftmost pixel in the high bit (np.unpackbits order) and 1 where
+ * the attractor is, or SHARD_U8, one byte per pixel holding the
+ * pixel value (function number + 1, or the hit count capped at 255).
+ * All values are little endian.
+ *
+ * The header is rewritten after every record, so a shard cut off by
+ * a killed run still counts the records it holds. Its indexoffset is
+ * 0 until shardclose writes the index; the records are always the
+ * numsamples blocks of recordbytes after the header, so readers can
+ * do without the index. shardresume reopens such a shard to carry
+ * on appending to it.
+ */
+#ifndef SHARDIO_H
+#define SHARDIO_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define SHARDMAGIC   "FRACSHD1"
+#define SHARDVERSION 1
+#define SHARDHEADER  128
+
+#define SHARD_BITS 0
+#define SHARD_U8   1
+
+#define SHARD_UNCONVERGED 1 //a record flag
+
+struct ShardHeader{
+    char magic[8];
+    uint32_t version, headerbytes;
+    uint32_t numsamples, firstfracnum;
+    uint32_t width, height, imagetype, numfuncs;
+    uint32_t numlabels, imagebytes;
+    uint64_t recordbytes, indexoffset;
+    uint8_t reserved[SHARDHEADER - 64];
+};
+
+struct ShardWriter{
+    FILE *fp;
+    struct ShardHeader header;
+    uint64_t *offsets;
+    int capacity;
+};
+
+struct Fractal;
+int shardnumlabels(int numfuncs);
+size_t shardrecordsize(int numfuncs, int width, int height, int imagetype);
+void shardrecord(struct Fractal *frac, int imagetype, unsigned char *record, size_t size);
+struct ShardWriter * shardopen(char *filename, int numfuncs, int width, int height, int imagetype, int firstfracnum);
+struct ShardWriter * shardresume(char *filename, int numfuncs, int width, int height, int imagetype,
+                                 int firstfracnum, int numsamples);
+void shardappend(struct ShardWriter *w, unsigned char *record);
+void shardclose(struct ShardWriter *w);
+
+#endif